@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  automation.c
+ *
+ *    Description:  Automation of knobs. Gains of knobs change in time
+ *                  by breakpoints read from a file and are interpolated
+ *                  for every window. Response curve of all knobs is kept
+ *                  between windows and only bins of knobs, whose gain has
+ *                  changed, are computed again.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "automation.h"
+#include "knobs.h"
+#include "my_std.h"
+
+/* Gain used for finding bins, which can be changed by a knob */
+#define AUTO_TEST_GAIN 6.0
+
+
+/*
+ *  Compares breakpoints by their time, for qsort.
+ */
+static int pointCmp(const void *a, const void *b) {
+	double ta = ((const struct auto_point *) a)->time;
+	double tb = ((const struct auto_point *) b)->time;
+	return (ta > tb) - (ta < tb);
+}
+
+/*
+ *  Returns lane of function "func" on bands from "band1" to "band2",
+ *   new one is added to the end of the list if it does not exist yet.
+ *   Returns NULL on error.
+ */
+static struct auto_lane *getLane(struct automation *au, char func, int band1, int band2) {
+	struct auto_lane *lane, *last = NULL;
+	for (lane=au->lanes; lane != NULL; lane=lane->next) {
+		if (lane->func == func && lane->band1 == band1 && lane->band2 == band2) {
+			return lane;
+		}
+		last = lane;
+	}
+
+	if ((lane = (struct auto_lane *) calloc(1, sizeof(struct auto_lane))) == NULL) {
+		perror("calloc");
+		return NULL;
+	}
+	lane->func = func;
+	lane->band1 = band1;
+	lane->band2 = band2;
+	lane->gain = NAN;
+	int b;
+	for (b=band1; b <= band2; b++) {
+		struct b_modif *nhead = addModif(lane->modifs, au->oct, func, b, 0.0);
+		if (nhead == NULL) {
+			freeModifs(lane->modifs);
+			free(lane);
+			return NULL;
+		}
+		lane->modifs = nhead;
+	}
+
+	if (last == NULL) {
+		au->lanes = lane;
+	} else {
+		last->next = lane;
+	}
+
+	return lane;
+}
+
+/*
+ *  Adds breakpoint to the lane.
+ */
+static void addPoint(struct auto_lane *lane, double time, double gain) {
+	if (lane->len == lane->max) {
+		lane->max = (lane->max == 0) ? 8 : 2*lane->max;
+		if ((lane->points = (struct auto_point *) realloc(lane->points, lane->max * sizeof(struct auto_point))) == NULL) {
+			perror("realloc");
+			exit (ERROR_EXIT_CODE);
+		}
+	}
+	lane->points[lane->len].time = time;
+	lane->points[lane->len].gain = gain;
+	lane->len++;
+}
+
+/*
+ *  Sets gain of all modifications of the lane and runs them on the
+ *   probe, which has bins from "st" to "tg" set to one.
+ */
+static void probeLane(struct automation *au, struct auto_lane *lane, double gain, int st, int tg) {
+	int i;
+	for (i=st; i<tg; i++) {
+		setCA(au->probe, i, 1.0, 1.0);
+	}
+	struct b_modif *m;
+	for (m=lane->modifs; m != NULL; m=m->next) {
+		m->gain = gain;
+	}
+	processModifs(lane->modifs, au->probe, au->oct, au->srate);
+}
+
+/*
+ *  Finds bins, which the lane can change, and allocates its response.
+ */
+static void initLane(struct automation *au, struct auto_lane *lane) {
+	int last = au->len/2 + 1;
+	probeLane(au, lane, AUTO_TEST_GAIN, 0, last);
+
+	lane->fst = last;
+	lane->ftg = 0;
+	int i;
+	for (i=0; i<last; i++) {
+		if (au->probe->c[i].re != 1.0) {
+			lane->fst = MIN(lane->fst, i);
+			lane->ftg = i + 1;
+		}
+	}
+	lane->fst = MIN(lane->fst, lane->ftg);
+	lane->resp = allocDoubles(MAX(lane->ftg - lane->fst, 1));
+
+	qsort(lane->points, lane->len, sizeof(struct auto_point), pointCmp);
+	log_out(45, "Automated knob %c on bands %d-%d has %d breakpoints, bins from %d to %d\n", lane->func, lane->band1, lane->band2, lane->len, lane->fst, lane->ftg);
+}
+
+/*
+ *  Reads automation from file "fpath" for spectrum of "len" bins in
+ *   sample rate "srate". Every line has time in seconds, band or range
+ *   of bands, function and gain in dB, e.g. "12.5 1-3 f -24". Lines
+ *   with the same bands and function are breakpoints of one knob, gain
+ *   is interpolated between them linearly. Empty lines and lines starting
+ *   with '#' are skipped. Response "base" of knobs, which do not change,
+ *   is then owned by the automation. Returns NULL on error.
+ */
+struct automation *loadAutomation(char *fpath, struct octave *oct, int len, int srate, double *base) {
+	FILE *fin;
+	if ((fin = fopen(fpath, "r")) == NULL) {
+		perror("fopen");
+		return NULL;
+	}
+
+	struct automation *au;
+	if ((au = (struct automation *) calloc(1, sizeof(struct automation))) == NULL) {
+		perror("calloc");
+		fclose(fin);
+		return NULL;
+	}
+	au->oct = oct;
+	au->len = len;
+	au->srate = srate;
+	au->base = base;
+
+	char line[256], bands[32], func;
+	double time, gain;
+	int lnum = 0;
+	while (fgets(line, sizeof(line), fin) != NULL) {
+		lnum++;
+		if (line[0] == '#' || sscanf(line, "%31s", bands) != 1) {
+			continue;
+		}
+		int band1 = 0, band2 = 0, used = 0;
+		int fields = sscanf(line, "%lf %31s %c %lf", &time, bands, &func, &gain);
+		int nbands = (fields == 4) ? sscanf(bands, "%d%n-%d%n", &band1, &used, &band2, &used) : 0;
+		if (nbands == 1) {
+			band2 = band1;
+		}
+		if (fields != 4 || nbands < 1 || used != (int) strlen(bands) || time < 0 || band2 < band1) {
+			fprintf(stderr, "Invalid breakpoint on line %d of \"%s\"\n", lnum, fpath);
+			fclose(fin);
+			freeAutomation(au);
+			return NULL;
+		}
+		if (gain < -24.0 || gain > 24.0) {
+			fprintf(stderr, "Gain on line %d of \"%s\" is out of range [-24; 24]dB\n", lnum, fpath);
+			fclose(fin);
+			freeAutomation(au);
+			return NULL;
+		}
+		struct auto_lane *lane;
+		if ((lane = getLane(au, func, band1, band2)) == NULL) {
+			fprintf(stderr, "Invalid knob on line %d of \"%s\"\n", lnum, fpath);
+			fclose(fin);
+			freeAutomation(au);
+			return NULL;
+		}
+		addPoint(lane, time, gain);
+	}
+	fclose(fin);
+
+	au->probe = allocCA(len);
+	au->probe->len = len;
+	au->curve = allocDoubles(len/2 + 1);
+	memcpy(au->curve, base, (len/2 + 1) * sizeof(double));
+	struct auto_lane *lane;
+	for (lane=au->lanes; lane != NULL; lane=lane->next) {
+		initLane(au, lane);
+	}
+
+	return au;
+}
+
+/*
+ *  Returns gain of the lane in given time.
+ */
+static double laneGain(struct auto_lane *lane, double time) {
+	struct auto_point *p = lane->points;
+	if (time <= p[0].time) {
+		return p[0].gain;
+	}
+	if (time >= p[lane->len - 1].time) {
+		return p[lane->len - 1].gain;
+	}
+
+	/* Find the last breakpoint before "time" */
+	int lo = 0, hi = lane->len - 1;
+	while (hi - lo > 1) {
+		int mid = (lo + hi)/2;
+		if (p[mid].time <= time) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	double r = (time - p[lo].time)/(p[hi].time - p[lo].time);
+
+	return p[lo].gain + r*(p[hi].gain - p[lo].gain);
+}
+
+/*
+ *  Returns response curve of all knobs in given time (in seconds). Only
+ *   responses of the lanes with changed gain are computed again, and the
+ *   curve is then updated only in the range of their bins. Returned curve
+ *   is owned by the automation and it is overwritten by the next call.
+ */
+double *automationCurve(struct automation *au, double time) {
+	int lo = au->len/2 + 1, hi = 0;
+	int i;
+	struct auto_lane *lane;
+	for (lane=au->lanes; lane != NULL; lane=lane->next) {
+		double gain = laneGain(lane, time);
+		if (gain == lane->gain || lane->fst == lane->ftg) {
+			continue;
+		}
+		lane->gain = gain;
+		probeLane(au, lane, gain, lane->fst, lane->ftg);
+		for (i=lane->fst; i < lane->ftg; i++) {
+			lane->resp[i - lane->fst] = au->probe->c[i].re;
+		}
+		lo = MIN(lo, lane->fst);
+		hi = MAX(hi, lane->ftg);
+	}
+
+	/* Knobs are multiplicative, bins are products of all responses */
+	for (i=lo; i<hi; i++) {
+		double g = au->base[i];
+		for (lane=au->lanes; lane != NULL; lane=lane->next) {
+			if (i >= lane->fst && i < lane->ftg) {
+				g *= lane->resp[i - lane->fst];
+			}
+		}
+		au->curve[i] = g;
+	}
+	au->updated += MAX(hi - lo, 0);
+	au->windows++;
+
+	return au->curve;
+}
+
+/*
+ *  Releases the automation with all its lanes.
+ */
+void freeAutomation(struct automation *au) {
+	struct auto_lane *lane;
+	while (au->lanes != NULL) {
+		lane = au->lanes;
+		au->lanes = lane->next;
+		freeModifs(lane->modifs);
+		free(lane->points);
+		free(lane->resp);
+		free(lane);
+	}
+	if (au->probe != NULL) {
+		freeCA(au->probe);
+	}
+	free(au->curve);
+	free(au->base);
+	free(au);
+}
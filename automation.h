@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  automation.h
+ *
+ *    Description:  Automation of knobs. Gains of knobs change in time
+ *                  by breakpoints read from a file and are interpolated
+ *                  for every window. Response curve of all knobs is kept
+ *                  between windows and only bins of knobs, whose gain has
+ *                  changed, are computed again.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef AUTOMATION_H_
+#define AUTOMATION_H_
+
+#include "complex.h"
+#include "equalizer.h"
+#include "knobs.h"
+
+/*
+ *  Gain of a knob from given time (in seconds).
+ */
+struct auto_point {
+	double time;
+	double gain;
+};
+
+/*
+ *  One automated knob, function applied on range of bands, with its
+ *   breakpoints sorted by time. Its response is stored only for bins
+ *   from "fst" to "ftg", which it can change.
+ */
+struct auto_lane {
+	char func;
+	int band1;
+	int band2;
+	struct auto_point *points;
+	int len;
+	int max;
+	struct b_modif *modifs;  /* Modifications of all bands of the range */
+	double gain;             /* Gain of the current response */
+	int fst, ftg;
+	double *resp;
+	struct auto_lane *next;
+};
+
+/*
+ *  All automated knobs for spectrum of "len" bins in sample rate "srate".
+ */
+struct automation {
+	struct auto_lane *lanes;
+	struct octave *oct;
+	int len;
+	int srate;
+	double *base;     /* Response of knobs, which do not change */
+	double *curve;    /* Response of all knobs in the current time */
+	C_ARRAY *probe;   /* For computing responses of lanes */
+	long updated;     /* Number of bins computed again */
+	long windows;     /* Number of evaluated curves */
+};
+
+
+extern struct automation *loadAutomation(char *fpath, struct octave *oct, int len, int srate, double *base);
+extern double *automationCurve(struct automation *au, double time);
+extern void freeAutomation(struct automation *au);
+
+#endif
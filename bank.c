@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  bank.c
+ *
+ *    Description:  Multirate filter bank engine. Sound track is split into
+ *                  octaves by repeated low-pass filtering and decimation
+ *                  (Laplacian pyramid), every octave is modified in its own
+ *                  reduced sample rate, so the low bands get fine frequency
+ *                  resolution, and the result is resynthesized. Pyramid
+ *                  reconstructs the input perfectly when no knob is set.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bank.h"
+#include "knobs.h"
+#include "fir.h"
+#include "equalizer.h"
+#include "complex.h"
+#include "my_std.h"
+
+/* Length of the half-band filter used for decimation and interpolation */
+#define BANK_TAPS 63
+/* Sample rate of the lowest level must not be lower than this (in Hz) */
+#define BANK_MIN_RATE 160
+/* Upper limit for the number of decimated levels */
+#define BANK_MAX_LEVELS 12
+
+
+/*
+ *  Returns number of decimations done for input in sample rate "srate".
+ */
+int bankLevels(int srate) {
+	int levels = 0;
+	while (levels < BANK_MAX_LEVELS && (srate >> (levels + 1)) >= BANK_MIN_RATE) {
+		levels++;
+	}
+
+	return levels;
+}
+
+/*
+ *  Filters given track by low-pass filter "lp" and keeps only every
+ *   second sample of the result.
+ */
+static C_ARRAY *decimate(C_ARRAY *in, C_ARRAY *lp) {
+	C_ARRAY *flt = convolveOS(in, lp, (lp->len - 1)/2);
+	C_ARRAY *out = allocCA((in->len + 1)/2);
+	out->len = out->max;
+
+	int i;
+	for (i=0; i < out->len; i++) {
+		out->c[i].re = flt->c[2*i].re;
+	}
+	freeCA(flt);
+
+	return out;
+}
+
+/*
+ *  Inserts zero between every two samples of "low" and filters the result
+ *   by low-pass filter "lp", returned track has "len" samples.
+ */
+static C_ARRAY *interpolate(C_ARRAY *low, C_ARRAY *lp, int len) {
+	C_ARRAY *up = allocCA(len);
+	up->len = len;
+
+	int i;
+	for (i=0; i < low->len && 2*i < len; i++) {
+		/* Zeros halved the energy, compensate it */
+		up->c[2*i].re = 2.0*low->c[i].re;
+	}
+	C_ARRAY *out = convolveOS(up, lp, (lp->len - 1)/2);
+	freeCA(up);
+
+	return out;
+}
+
+/*
+ *  Splits input track into octaves, modifies each of them in its own sample
+ *   rate by windows of "wlen" samples and puts them back together. Returns
+ *   new array with the result, which has the same length as the input.
+ */
+C_ARRAY *filterBank(C_ARRAY *in, struct b_modif *head, struct octave *oct, int srate, int wlen) {
+	int levels = bankLevels(srate);
+	/* Half-band filter, cut-off is in one quarter of the sample rate */
+	C_ARRAY *lp = lowpassFIR(srate/4.0, srate, BANK_TAPS);
+	C_ARRAY **gauss;   /* Low-pass versions of the input, halved in every level */
+	C_ARRAY **detail;  /* Difference between two neighbouring low-pass versions */
+
+	if ((gauss = (C_ARRAY **) malloc((levels + 1) * sizeof(C_ARRAY *))) == NULL ||
+	    (detail = (C_ARRAY **) malloc((levels + 1) * sizeof(C_ARRAY *))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	log_out(45, "Filter bank with %d levels, the lowest sample rate is %dHz\n", levels, srate >> levels);
+
+	/* Analysis, every level keeps only the highest octave of its sample rate */
+	gauss[0] = in;
+	int l, i;
+	for (l=0; l<levels; l++) {
+		gauss[l+1] = decimate(gauss[l], lp);
+		C_ARRAY *pred = interpolate(gauss[l+1], lp, gauss[l]->len);
+		detail[l] = pred;
+		for (i=0; i < pred->len; i++) {
+			detail[l]->c[i].re = gauss[l]->c[i].re - pred->c[i].re;
+		}
+	}
+
+	/* The lowest level is modified as a whole */
+	C_ARRAY *res = allocCA(gauss[levels]->len);
+	equalizeWindows(gauss[levels], res, head, oct, srate >> levels, wlen, 0.0, (srate >> levels)/2.0);
+
+	/* Synthesis, from the lowest level to the highest one */
+	for (l=levels-1; l >= 0; l--) {
+		C_ARRAY *mod = allocCA(detail[l]->len);
+		equalizeWindows(detail[l], mod, head, oct, srate >> l, wlen, (srate >> l)/4.0, (srate >> l)/2.0);
+
+		C_ARRAY *up = interpolate(res, lp, detail[l]->len);
+		for (i=0; i < up->len; i++) {
+			up->c[i].re += mod->c[i].re;
+		}
+		freeCA(mod); freeCA(res);
+		freeCA(detail[l]); freeCA(gauss[l+1]);
+		res = up;
+	}
+
+	free(gauss); free(detail);
+	freeCA(lp);
+
+	return res;
+}
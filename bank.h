@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  bank.h
+ *
+ *    Description:  Multirate filter bank engine. Sound track is split into
+ *                  octaves by repeated low-pass filtering and decimation
+ *                  (Laplacian pyramid), every octave is modified in its own
+ *                  reduced sample rate, so the low bands get fine frequency
+ *                  resolution, and the result is resynthesized. Pyramid
+ *                  reconstructs the input perfectly when no knob is set.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef BANK_H_
+#define BANK_H_
+
+#include "complex.h"
+#include "equalizer.h"
+#include "knobs.h"
+
+
+extern int bankLevels(int srate);
+extern C_ARRAY *filterBank(C_ARRAY *in, struct b_modif *head, struct octave *oct, int srate, int wlen);
+
+#endif
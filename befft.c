@@ -60,6 +60,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <getopt.h>
 
 /* Interpret data in chart */
 #include "gnuplot_i.h"
@@ -69,9 +70,56 @@
 #include "complex.h"
 #include "string.h"
 #include "wave.h"
+#include "knobs.h"
+#include "fir.h"
+#include "biquad.h"
+#include "bank.h"
+#include "multires.h"
+#include "prof.h"
+#include "logger.h"
+#include "fft.h"
+#include "speccache.h"
+#include "server.h"
+#include "live.h"
+#include "automation.h"
+#include "shmring.h"
+#include "daemon.h"
+#include "segment.h"
+
+/* Default size of one window (# of samples to transform in one step) */
+#define DEFAULT_WLEN (4096*2)
+/* Allowed range of window sizes */
+#define MIN_WLEN 16
+#define MAX_WLEN 65536
+/* Sample rate used for raw input data (in Hz) */
+#define DEFAULT_SRATE 44100
+/* Default number of FIR filter coefficients */
+#define DEFAULT_TAPS 1023
+/* Size of one window in every level of the filter bank */
+#define BANK_WLEN 2048
+/* Default silence level (in dBFS) for skipping of silent windows */
+#define DEFAULT_SILENCE -96
+/* Samples read around time range for engines, which remember more than one window */
+#define RANGE_MARGIN 65536
 
-/* Size of one window (# of samples to transform in one step) */
-#define WLEN (4096*2)
+/*
+ *  Engines, which can be used to apply modifications on the input.
+ */
+enum engine {
+	ENGINE_FFT = 0,  /* Modify spectrum of each window (default) */
+	ENGINE_FIR = 1,  /* Design FIR filter and convolve with it */
+	ENGINE_BIQUAD = 2, /* Filter by cascade of biquads, no latency */
+	ENGINE_BANK = 3, /* Modify every octave in its own sample rate */
+	ENGINE_MULTIRES = 4, /* Modify regions of spectrum with own window lengths */
+};
+
+/*
+ *  Options, which have only long form.
+ */
+enum long_option {
+	OPT_START = 256,    /* --start sec */
+	OPT_DURATION = 257, /* --duration sec */
+};
 
 
 /* Stores the name of this program */
@@ -81,7 +129,7 @@ char const *program_name;
  *  Print out to the standard output information about usage of this program.
  */
 static void usage(void) {
-	fprintf(stderr, "Usage: %s -f in_file [-w] [-r denom] [-k list] [-d level]\n"
+	fprintf(stderr, "Usage: %s -f in_file [-w] [-r denom] [-k list]... [-P presets] [-G groups] [-L file] [-A file] [-M ring] [-D spool] [-n workers] [-X procs] [-e engine] [-t taps] [-m] [-b block] [-s level] [-p report] [-a] [-W wisdom] [-K kernel] [-S] [-j threads] [-l wlen] [-C dir] [-H] [-I] [-U socket] [--start sec] [--duration sec] [-d level]\n"
 		"   -f in_file: set the name of an input file to \"in_file\"\n\n"
 		"   -w:         input file is in WAV format\n\n"
 		"   -r denom:   set Octave bands control to [1/denom] (must be in range [1; 24] by standard ISO)\n"
@@ -92,9 +140,73 @@ static void usage(void) {
 		"        function:    must be one of \"f\" for flat, \"p\" for peak, or \"n\" for next\n"
 		"        gain:        integer value from range [-24; 24] (in dB) with, or without its sign\n"
 		"        EXAMPLE:     -k 1f+20,7-9n-24,42p21 (use Flat function applied to the first band with gain 20dB,\n"
-	        "                     then use Next function applied on bands 7,8 and 9 with gain -24dB, etc.)\n\n"
+	        "                     then use Next function applied on bands 7,8 and 9 with gain -24dB, etc.)\n"
+		"        more \"-k\" options render more presets named \"1\", \"2\", ... from one analysis of the input\n\n"
+		"   -P presets: file with named presets, one \"name list\" per line, all of them are rendered from one\n"
+		"               analysis of the input by fft engine, output of every preset is written into out_file\n"
+		"               with \"_name\" added before the extension\n\n"
+		"   -G groups:  split input into stems by groups of bands, e.g. \"sub:1-2,low:3-4,mid:5-7,high:8-10\"\n"
+		"               (band ranges of one group are separated by '+'), one output is written for every group\n"
+		"               and one more for the rest of the spectrum, named like outputs of presets, stems sum\n"
+		"               back to the input (fft engine only)\n\n"
+		"   -L file:    live knobs, \"file\" with list of knobs (in format of -k, more lines are joined) is watched\n"
+		"               during processing and every change is applied from the next window of all channels\n"
+		"               with crossfade, knobs of -k are used only until the file can be read (fft engine only)\n\n"
+		"   -A file:    automation of knobs, every line of \"file\" is breakpoint \"time bands function gain\",\n"
+		"               e.g. \"12.5 1-3 f -24\" (time in seconds), gain of every knob is interpolated between its\n"
+		"               breakpoints for every window, knobs of -k stay constant (fft engine only)\n\n"
+		"   -M ring:    instead of reading in_file, attach shared memory ring \"ring\" created by producer (see\n"
+		"               shmpair) and modify its blocks in place by fft engine, every block is one window\n\n"
+		"   -D spool:   daemon, instead of reading in_file, every WAV file \"name.wav\" which appears in \"spool/incoming\"\n"
+		"               is modified by fft engine with knobs from \"name.knobs\" (in format of -L file, knobs of -k\n"
+		"               are used if there is no such file, it has to be written before the WAV file), output is\n"
+		"               moved into \"spool/done\" when it is complete, failed jobs into \"spool/failed\", state of\n"
+		"               the daemon is in \"spool/status\", runs until SIGINT or SIGTERM\n\n"
+		"   -n workers: number of jobs processed by the daemon at once (default value is the number of processors)\n\n"
+		"   -X procs:   split WAV input into \"procs\" segments of whole windows, every segment is modified by its own\n"
+		"               worker process connected by pipes and the results are put together, output of fft engine\n"
+		"               is the same as without it, other engines get margins around segments like with --start\n\n"
+		"   -e engine:  select how the modifications are applied, \"fft\" modifies spectrum of every window,\n"
+		"               \"fir\" turns response of all knobs into FIR filter and applies it by overlap-save convolution,\n"
+		"               \"biquad\" maps every knob to biquad filter and applies them as a cascade without latency,\n"
+		"               \"bank\" splits input into octaves by multirate filter bank and modifies each of them separately,\n"
+		"               \"multires\" splits spectrum into regions, each of them is modified with its own window length\n"
+		"        (default value is fft)\n\n"
+		"   -t taps:    number of FIR filter coefficients for fir engine (must be in range [3; 65535])\n"
+		"        (default value is %d, linear phase filter has always odd length)\n\n"
+		"   -m:         design minimum phase FIR filter instead of linear phase one\n\n"
+		"   -b block:   fir engine splits the filter into partitions of \"block\" samples (power of 2 in range\n"
+		"               [2; 65536]) and convolves them with input blocks of the same length, so the latency\n"
+		"               is only \"block\" samples (plus delay of the filter)\n\n"
+		"   -s level:   windows, which stay bellow \"level\" dBFS even after the highest gain of all knobs,\n"
+		"               are copied to the output without any change\n"
+		"        (default value is %d)\n\n"
+		"   -p report:  measure duration of every stage (reading, FFT, modifications, IFFT, plotting, writing)\n"
+		"               and print summary at the end, the summary is also written to \"report\" in JSON format,\n"
+		"               unless \"report\" is \"-\"\n\n"
+		"   -a:         debugging messages are printed asynchronously by separate thread, so they slow down\n"
+		"               the processing less, but they may appear later than other output\n\n"
+		"   -W wisdom:  file with the fastest FFT kernel for every transform size, sizes which are not there\n"
+		"               are measured on the first use and added to the file, \"-\" turns measuring off\n"
+		"        (default value is %s)\n\n"
+		"   -K kernel:  use given FFT kernel for all sizes instead of the fastest one, one of \"recursive\",\n"
+		"               \"radix2\", \"radix4\", \"radix8\", \"stockham\", \"leaf16\", \"leaf32\", \"leaf64\", \"fourstep\",\n"
+		"               \"mixed\" or \"bluestein\", kernel which cannot compute some size is not used for it\n\n"
+		"   -S:         compute spectrum of every whole channel by one transform and write it into spectrum_N.mat\n\n"
+		"   -j threads: number of threads used by four-step FFT kernel for huge transforms\n"
+		"        (default value is the number of processors)\n\n"
+		"   -l wlen:    number of samples in one window of FFT engine, must be in range [%d; %d], it does not have\n"
+		"        to be power of 2, e.g. 4800 or 9600 align bands with 48kHz sound (default value is %d)\n\n"
+		"   -C dir:     keep spectra of all windows of fft engine in cache file in directory \"dir\", next runs on\n"
+		"        the same input with the same window length take them from the cache instead of computing FFT\n\n"
+		"   -H:         store spectra in the cache as half precision numbers, file is twice smaller, but less precise\n\n"
+		"   -I:         interactive server, spectra of all windows are kept in memory and commands \"knobs list\",\n"
+		"        \"render path [start [duration]]\", \"info\" and \"quit\" are read from the standard input (WAV only)\n\n"
+		"   -U socket:  the same server, but commands are read from clients of local UNIX socket \"socket\"\n\n"
+		"   --start sec:    process only part of WAV input from \"sec\" seconds, output is short WAV with this part\n\n"
+		"   --duration sec: process only \"sec\" seconds of WAV input (from the start of the part)\n\n"
 		"   -d level:   changes debug level to \"level\", smaller value means more info\n"
-		"        (default value is 90, used range is [1; 100])\n", program_name);
+		"        (default value is 90, used range is [1; 100])\n", program_name, DEFAULT_TAPS, DEFAULT_SILENCE, DEFAULT_WISDOM, MIN_WLEN, MAX_WLEN, DEFAULT_WLEN);
 	exit (ERROR_EXIT_CODE);
 }
 
@@ -209,169 +321,764 @@ static void writeOutput(char *file_name, C_ARRAY *ca) {
 
 
 /*
- *  Structure used to save all modification that will
- *   be applied in linked list.
+ *  Plots spectrum "re" of "w_i"-th window, applies all modifications on
+ *   it and plots it again. Arrays "x" and "y" are used for plotting.
  */
-struct b_modif {
-	/* C_ARRAY *sample, int srate, double gain [-24,+24] */
-	void (*modif_f)(C_ARRAY *, struct band *, int, double);
-	/* Which band will be modified */
-	int band_id;
-	/* What will be the gain passed into the modification function */
-	double gain;
-	/* Next operation in this linked list */
-	struct b_modif *next;
-};
+static void modifyWindow(C_ARRAY *re, int w_i, struct b_modif *modifs_head, struct octave *oct, int srate, double *x, double *y) {
+	gnuplot_ctrl * g;
+	int j; /* For iteration through all points in graph */
+
+	/* Plot graph of decibel values of each frequency */
+	PROF_START(t_plot);
+	g = gnuplot_init();
+	gnuplot_cmd(g, "set terminal png");
+	gnuplot_setstyle(g, "lines");
+	gnuplot_cmd(g, "set output \"fft_window_%d.png\"", w_i+1);
+	gnuplot_set_ylabel(g, "dBPS");
+	gnuplot_set_xlabel(g, "frequency (Hz)");
+	for (j=0; j < re->len; j++) {
+		x[j] = j;
+		y[j] = decibel(re->c[j]); 
+	}
+	gnuplot_plot_xy(g, x, y, re->len/2, "FT");
+	PROF_STOP(PROF_PLOT, t_plot);
+
+	/* Apply modifications */
+	PROF_START(t_modifs);
+	processModifs(modifs_head, re, oct, srate);
+	PROF_STOP(PROF_MODIFS, t_modifs);
+
+	/* Plot graph of modified values in decibel units */
+	PROF_START(t_mplot);
+	gnuplot_cmd(g, "set terminal png");
+	gnuplot_setstyle(g, "lines");
+	gnuplot_cmd(g, "set output \"fft_window_%d.png\"", w_i+1);
+	for (j=0; j < re->len; j++) {
+		x[j] = j;
+		y[j] = decibel(re->c[j]); 
+	}
+	gnuplot_plot_xy(g, x, y, re->len/2, "FT-modif");
+	gnuplot_close(g);
+	PROF_STOP(PROF_PLOT, t_mplot);
+}
 
 /*
- *  Add new modification to the linked list structure b_modif.
+ *  Modifies "cnt" samples of input track "in" from position "wst" as
+ *   "w_i"-th window, which is padded by zeros to "wlen" samples in "win",
+ *   transformed by FFT, modified and transformed back into "out". If
+ *   "cache" is given, spectrum of the window of channel "ch" is taken
+ *   from it instead.
  */
-struct b_modif *addModif(struct b_modif *head, struct octave *oct, char func, int band_id, double gain) {
-	printf("New modifier: func=%c band_id=%d gain=%.2fdB\n", func, band_id, gain);
-	struct b_modif *nbm;
-	if ((nbm = (struct b_modif *) malloc(sizeof(struct b_modif))) == NULL) {
-		perror("malloc");
+static void fftWindow(C_ARRAY *in, C_ARRAY *out, C_ARRAY *win, int wst, int cnt, int wlen, int w_i, struct b_modif *modifs_head, struct octave *oct, int srate, struct spec_cache *cache, int ch, double *x, double *y) {
+	C_ARRAY *re, *ire;  /* For temporary storing FFT and IFFT results */
+
+	/* Transform sound to frequency domain, or take it from the cache */
+	PROF_START(t_fft);
+	if (cache != NULL) {
+		re = cachedSpectrum(cache, ch, w_i);
+	} else {
+		/* Copy data from input track into new window, the last one is padded */
+		initCA(win, wlen, 0);
+		copyCA(in, wst, win, 0, cnt);
+		win->len = wlen;
+
+		/* Not actually used, window functions needs to handle overlapping */
+		/* 
+		 * hammingWindow(win, 0.53836, 0.46164);
+		 * planckWindow(win, 0.1);
+		 * tukeyWindow(win, 0.1);
+		 */
+
+		re = fft(win);
 	}
+	PROF_STOP(PROF_FFT, t_fft);
 
-	/* Check, if given band_id is really part of given Octave */
-	if (band_id < 1 || band_id > oct->len) {
-		fprintf(stderr, "Band ID is out of range [1; %d]\n", oct->len);
-		usage();
+	modifyWindow(re, w_i, modifs_head, oct, srate, x, y);
+
+	/* Transform back to time domain */
+	PROF_START(t_ifft);
+	ire = ifft(re);
+	PROF_STOP(PROF_IFFT, t_ifft);
+	/* Add new modified result to the end of the output array */
+	copyCA(ire, 0, out, wst, cnt);
+
+	freeCA(ire); freeCA(re);
+}
+
+/*
+ *  Applies all modifications on input track "in" window by window,
+ *   every window of "wlen" samples is transformed by FFT, modified and
+ *   transformed back, the last one is padded by zeros. Result is stored
+ *   in "out". Arrays "x" and "y" (for at least "wlen" values) are used
+ *   for plotting the spectrum of each window. Spectra are taken from
+ *   "cache" (as channel "ch"), if it is not NULL.
+ */
+static void fftEngine(C_ARRAY *in, C_ARRAY *out, struct b_modif *modifs_head, struct octave *oct, int srate, int wlen, struct spec_cache *cache, int ch, double *x, double *y) {
+	C_ARRAY *win;       /* Window for wlen samples, works as kind of buffer */
+	win = allocCA(wlen);
+
+	int ilen = in->len;
+
+	/*
+	 *  Divide input samples into windows of specific length
+	 */
+	int win_num = (int) ceil((double) ilen/wlen);
+	log_out(45, "Total number of windows is %d\n", win_num);
+	log_out(71, "\n");
+	int w_i;
+	for (w_i=0; w_i < win_num; w_i++) {
+		log_out(55, "Processing %d. window:\n", w_i+1);
+		windows_total++;
+		/* Silent window stays silent, it only follows broadband gain of the knobs */
+		int cnt = MIN(wlen, ilen - w_i*wlen);
+		if (isSilent(in, w_i*wlen, cnt)) {
+			log_out(55, "Window is silent, copying it\n");
+			copySilent(in, w_i*wlen, out, w_i*wlen, cnt, silence_gain);
+			windows_skipped++;
+			continue;
+		}
+		fftWindow(in, out, win, w_i*wlen, cnt, wlen, w_i, modifs_head, oct, srate, cache, ch, x, y);
 	}
-	nbm->band_id = band_id;
-	/* Check range of given gain, allowed are only values from range [-24; 24] */
-	if (gain < -24.0 || gain > 24.0) {
-		fprintf(stderr, "Gain is out of range [-24; 24]dB\n");
-		usage();
+
+	freeCA(win);
+}
+
+/*
+ *  The same as fftEngine, but for two real tracks "in1" and "in2" of the
+ *   same length at once. Every pair of windows is packed into one complex
+ *   window (the first track in real parts, the second one in imaginary
+ *   parts), so only one FFT and one IFFT is needed for both of them.
+ *   Results are stored in "out1" and "out2". With "cache", spectra are
+ *   taken from it as channels "ch" and "ch"+1.
+ */
+static void fftEnginePair(C_ARRAY *in1, C_ARRAY *in2, C_ARRAY *out1, C_ARRAY *out2, struct b_modif *modifs_head, struct octave *oct, int srate, int wlen, struct spec_cache *cache, int ch, double *x, double *y) {
+	C_ARRAY *re1, *re2, *ire;  /* For temporary storing FFT and IFFT results */
+	C_ARRAY *win;              /* Window for wlen samples of both tracks */
+	win = allocCA(wlen);
+
+	int ilen = in1->len;
+	int win_num = (int) ceil((double) ilen/wlen);
+	log_out(45, "Total number of windows is %d, two channels are transformed together\n", win_num);
+	log_out(71, "\n");
+	int w_i, j;
+	for (w_i=0; w_i < win_num; w_i++) {
+		log_out(55, "Processing %d. window of both channels:\n", w_i+1);
+		int wst = w_i*wlen;
+		int cnt = MIN(wlen, ilen - wst);
+		windows_total += 2;
+
+		/* Silent windows are copied, the other one is then modified alone */
+		int silent1 = isSilent(in1, wst, cnt);
+		int silent2 = isSilent(in2, wst, cnt);
+		if (silent1) {
+			copySilent(in1, wst, out1, wst, cnt, silence_gain);
+			windows_skipped++;
+		}
+		if (silent2) {
+			copySilent(in2, wst, out2, wst, cnt, silence_gain);
+			windows_skipped++;
+		}
+		if (silent1 && silent2) {
+			log_out(55, "Both windows are silent, copying them\n");
+			continue;
+		}
+		if (silent1 || silent2) {
+			log_out(55, "Window of one channel is silent, copying it\n");
+			fftWindow(silent1 ? in2 : in1, silent1 ? out2 : out1, win, wst, cnt, wlen, w_i, modifs_head, oct, srate, cache, silent1 ? ch + 1 : ch, x, y);
+			continue;
+		}
+
+		/* Transform both tracks to frequency domain, or take them from the cache */
+		PROF_START(t_fft);
+		if (cache != NULL) {
+			re1 = cachedSpectrum(cache, ch, w_i);
+			re2 = cachedSpectrum(cache, ch + 1, w_i);
+		} else {
+			initCA(win, wlen, 0);
+			for (j=0; j<cnt; j++) {
+				setCA(win, j, in1->c[wst + j].re, in2->c[wst + j].re);
+			}
+			win->len = wlen;
+			fftPair(win, &re1, &re2);
+		}
+		PROF_STOP(PROF_FFT, t_fft);
+
+		modifyWindow(re1, w_i, modifs_head, oct, srate, x, y);
+		modifyWindow(re2, w_i, modifs_head, oct, srate, x, y);
+
+		/* Transform both back to time domain */
+		PROF_START(t_ifft);
+		ire = ifftPair(re1, re2);
+		PROF_STOP(PROF_IFFT, t_ifft);
+		for (j=0; j<cnt; j++) {
+			setCA(out1, wst + j, ire->c[j].re, 0.0);
+			setCA(out2, wst + j, ire->c[j].im, 0.0);
+		}
+
+		freeCA(ire); freeCA(re1); freeCA(re2);
 	}
-	nbm->gain = gain;
-	nbm->next = head;
+	out1->len = out2->len = ilen;
 
-	/* Decide which function will be used to modificate this band */
-	switch (func) {
-		case 'p':
-			nbm->modif_f = peakBand;
-			break;
-		case 'f':
-			nbm->modif_f = flatBand;
-			break;
-		case 'n':
-			nbm->modif_f = nextBand;
-			break;
-		default:
-			fprintf(stderr, "Unknown modification function\n");
-			usage();
-			break;
+	freeCA(win);
+}
+
+/*
+ *  Returns copy of spectrum "re" multiplied by compiled response of
+ *   preset "pr", or by mask of stem.
+ */
+static C_ARRAY *presetSpectrum(C_ARRAY *re, struct preset *pr) {
+	C_ARRAY *mod = allocCA(re->len);
+	copyCA(re, 0, mod, 0, re->len);
+	PROF_START(t_modifs);
+	if (pr->stem) {
+		applyMask(pr->gains, mod);
+	} else {
+		applyGains(pr->gains, mod);
 	}
+	PROF_STOP(PROF_MODIFS, t_modifs);
 
-	return nbm;
+	return mod;
 }
 
 /*
- *  Parse option inputs and appropriately initialize b_modif as a linked list
- *   of these modifications.
- *   
- *  We assume the input is in correct format, therefore only the last two parameters
- *   are being checked, bad function is recognized when we are adding new 
- *   modification to the linked list.
- *
- *  Element of the string "bands_in" should have following format:
- *   [band_start(number)][-band_end(number)][function(char)][sign(char)][gain(number)]
- *   where "band_end" and "sing" are not required, elements should be separated by comma.
- */
-struct b_modif *initModifs(struct b_modif *head, struct octave *oct, char *bands_in) {
-	int  i=0;     /* Defines position in bands_in string */
-	char akt;     /* Currently proccesed character */
-	int  band_id1;/* First band ID value, that was readed from current element */
-	int  band_id2;/* Specifies the second range margin of bands that will be modified */
-	char func;    /* Function defining character, readed from current element */
-	int  gain;    /* Gain value from current element */
-	STRING token = alloc_string(20);
-	while ((akt = bands_in[i++]) != '\0' && i < strlen(bands_in)) {
-		/* First we read band_id, which is integer */
-		init_string(&token, 20, 0);
-		while (akt >= '0' && akt <= '9') {
-			append(&token, akt);
-			akt = bands_in[i++];
-		}
-		band_id1 = atoi(token.text);
-		band_id2 = band_id1;
-
-		/* Read the second range margin if exists */
-		if (akt == '-') {
-			init_string(&token, 20, 0);
-			akt = bands_in[i++];
-			while (akt >= '0' && akt <= '9') {
-				append(&token, akt);
-				akt = bands_in[i++];
+ *  Transforms "cnt" samples of track "in" from position "wst" as "w_i"-th
+ *   window (padded to "wlen" samples in "win") only once, or takes its
+ *   spectrum from "cache", and renders it with every preset into channel
+ *   "ch" of its output in "pouts".
+ */
+static void presetWindow(C_ARRAY *in, C_ARRAY *win, int wst, int cnt, int wlen, int w_i, struct preset *presets, C_ARRS **pouts, struct spec_cache *cache, int ch) {
+	C_ARRAY *re, *mod, *ire;
+	struct preset *pr;
+	int p_i;
+
+	PROF_START(t_fft);
+	if (cache != NULL) {
+		re = cachedSpectrum(cache, ch, w_i);
+	} else {
+		initCA(win, wlen, 0);
+		copyCA(in, wst, win, 0, cnt);
+		win->len = wlen;
+		re = fft(win);
+	}
+	PROF_STOP(PROF_FFT, t_fft);
+
+	for (pr=presets, p_i=0; pr != NULL; pr=pr->next, p_i++) {
+		mod = presetSpectrum(re, pr);
+		PROF_START(t_ifft);
+		ire = ifft(mod);
+		PROF_STOP(PROF_IFFT, t_ifft);
+		copyCA(ire, 0, pouts[p_i]->carrs[ch], wst, cnt);
+		freeCA(ire); freeCA(mod);
+	}
+
+	freeCA(re);
+}
+
+/*
+ *  Renders all "presets" of track "in1" (and of track "in2" of the same
+ *   length, if it is not NULL) like fftEngine, resp. fftEnginePair, does
+ *   for one set of knobs. Spectrum of every window is computed only once
+ *   and only the invers transform is done for each preset, result of
+ *   i-th preset is stored as channel "ch" (and "ch"+1) of "pouts[i]".
+ *   Windows are not plotted, there would be too many of them.
+ */
+static void presetEngine(C_ARRAY *in1, C_ARRAY *in2, struct preset *presets, C_ARRS **pouts, int wlen, struct spec_cache *cache, int ch) {
+	C_ARRAY *re1, *re2, *mod1, *mod2, *ire;
+	C_ARRAY *win;
+	win = allocCA(wlen);
+	struct preset *pr;
+	int p_i, j;
+
+	int ilen = in1->len;
+	int win_num = (int) ceil((double) ilen/wlen);
+	log_out(45, "Total number of windows is %d, every one is rendered with all presets\n", win_num);
+	int w_i;
+	for (w_i=0; w_i < win_num; w_i++) {
+		log_out(55, "Processing %d. window:\n", w_i+1);
+		int wst = w_i*wlen;
+		int cnt = MIN(wlen, ilen - wst);
+
+		/* Silent windows are only scaled by broadband gain of every preset */
+		int silent1 = isSilent(in1, wst, cnt);
+		int silent2 = (in2 == NULL) || isSilent(in2, wst, cnt);
+		windows_total += (in2 != NULL) ? 2 : 1;
+		for (pr=presets, p_i=0; pr != NULL; pr=pr->next, p_i++) {
+			if (silent1) {
+				copySilent(in1, wst, pouts[p_i]->carrs[ch], wst, cnt, pr->broadband);
+			}
+			if (in2 != NULL && silent2) {
+				copySilent(in2, wst, pouts[p_i]->carrs[ch+1], wst, cnt, pr->broadband);
 			}
-			band_id2 = atoi(token.text);
+		}
+		windows_skipped += silent1 + (in2 != NULL && silent2);
+		if (silent1 && silent2) {
+			continue;
+		}
+		if (silent1 || silent2) {
+			presetWindow(silent1 ? in2 : in1, win, wst, cnt, wlen, w_i, presets, pouts, cache, silent1 ? ch + 1 : ch);
+			continue;
 		}
 
-		/* Now read character defining the function to be used */
-		func = akt;
-		akt = bands_in[i++];
-
-		/* 
-		 * Now read the gain (integer number with sign + or -)
-		 * No sign is also correct, its meaning is + sign.
-		 */
-		init_string(&token, 20, 0);
-		if (akt == '+' || akt == '-' || (akt >= '0' && akt <= '9')) {
-			append(&token, akt);
-			akt = bands_in[i++];
+		/* Both tracks are transformed together */
+		PROF_START(t_fft);
+		if (cache != NULL) {
+			re1 = cachedSpectrum(cache, ch, w_i);
+			re2 = cachedSpectrum(cache, ch + 1, w_i);
 		} else {
-			/* The only thing we check for (might be unclear for users) */
-			fprintf(stderr, "Incorrect sign before gain number\n");
-			usage();
+			initCA(win, wlen, 0);
+			for (j=0; j<cnt; j++) {
+				setCA(win, j, in1->c[wst + j].re, in2->c[wst + j].re);
+			}
+			win->len = wlen;
+			fftPair(win, &re1, &re2);
 		}
-		/* Read the rest of the gain number (if exists) */
-		while (akt >= '0' && akt <= '9') {
-			append(&token, akt);
-			akt = bands_in[i++];
+		PROF_STOP(PROF_FFT, t_fft);
+
+		for (pr=presets, p_i=0; pr != NULL; pr=pr->next, p_i++) {
+			mod1 = presetSpectrum(re1, pr);
+			mod2 = presetSpectrum(re2, pr);
+			PROF_START(t_ifft);
+			ire = ifftPair(mod1, mod2);
+			PROF_STOP(PROF_IFFT, t_ifft);
+			for (j=0; j<cnt; j++) {
+				setCA(pouts[p_i]->carrs[ch], wst + j, ire->c[j].re, 0.0);
+				setCA(pouts[p_i]->carrs[ch+1], wst + j, ire->c[j].im, 0.0);
+			}
+			freeCA(ire); freeCA(mod1); freeCA(mod2);
 		}
-		gain = atoi(token.text);
 
-		/* 
-		 * Go through the whole range of given bands IDs and add
-		 * each of them as a new modification to the linked list.
-		 */
-		int j;
-		for (j=band_id1; j <= band_id2; j++) {
-			head = addModif(head, oct, func, j, gain);
+		freeCA(re1); freeCA(re2);
+	}
+	for (pr=presets, p_i=0; pr != NULL; pr=pr->next, p_i++) {
+		pouts[p_i]->carrs[ch]->len = ilen;
+		if (in2 != NULL) {
+			pouts[p_i]->carrs[ch+1]->len = ilen;
 		}
 	}
-	free_string(&token);
 
-	return head;
+	freeCA(win);
+}
+
+/*
+ *  Response curve of the next window, the last one published by live
+ *   knobs "ctx".
+ */
+static double *liveCurve(void *ctx) {
+	return liveAcquire((struct live_knobs *) ctx);
+}
+
+/*
+ *  Live knobs "ctx" are not used by the finished window anymore.
+ */
+static void liveDone(void *ctx) {
+	liveQuiescent((struct live_knobs *) ctx);
+}
+
+/*
+ *  Automation and index of the next window, which it is evaluated for.
+ */
+struct auto_pos {
+	struct automation *au;
+	int w_i;
+};
+
+/*
+ *  Response curve of automation "ctx" in the middle of the next window.
+ */
+static double *automationAt(void *ctx) {
+	struct auto_pos *ap = (struct auto_pos *) ctx;
+	double t = (ap->w_i++ + 0.5)*ap->au->len/ap->au->srate;
+	return automationCurve(ap->au, t);
 }
 
 /*
- *  Execute all of the modifications in the b_modif linked list on "ca" array.
+ *  Applies knobs, which change in time, on all input tracks "ins" like
+ *   fftEngine, but window by window of all tracks together, so that every
+ *   change comes at the same time in all tracks. Curve of the knobs is
+ *   taken from "curve" at the start of every window (once per window, in
+ *   their order), when it is another curve than the one of the previous
+ *   window, the window is transformed back with both of them and
+ *   crossfaded from the old one to the new one. Function "done" (if not NULL) is called after every window.
+ *   Results are stored in "outs", returns number of crossfades.
  */
-void processModifs(struct b_modif *head, C_ARRAY *ca, struct octave *oct, int srate) {
-	struct b_modif *actb;
-	actb = head;
-	/* Go through the linked list and apply each modification */
-	while (actb != NULL) {
-		struct band *bnd = getBand(oct, actb->band_id);
-		log_out(71, "Processing modification of %d. band with gain %.2f\n", actb->band_id, actb->gain);
-		actb->modif_f(ca, bnd, srate, actb->gain);
-		actb = actb->next;
+static int curveEngine(C_ARRS *ins, C_ARRS *outs, int wlen, double *(*curve)(void *), void (*done)(void *), void *ctx) {
+	C_ARRAY *re, *mod, *ire, *old;
+	C_ARRAY *win;
+	win = allocCA(wlen);
+	double *gains, *prev = NULL;
+	int i, j, changes = 0;
+
+	int ilen = 0;
+	for (i=0; i < ins->len; i++) {
+		ilen = MAX(ilen, ins->carrs[i]->len);
 	}
-	log_out(71, "\n");
+	int win_num = (int) ceil((double) ilen/wlen);
+	log_out(45, "Total number of windows is %d, knobs change in time\n", win_num);
+	int w_i;
+	for (w_i=0; w_i < win_num; w_i++) {
+		int wst = w_i*wlen;
+		gains = curve(ctx);
+		int fade = (prev != NULL && gains != prev);
+		if (fade) {
+			log_out(55, "Knobs changed in %d. window, crossfading\n", w_i+1);
+			changes++;
+		}
+
+		for (i=0; i < ins->len; i++) {
+			int cnt = MIN(wlen, ins->carrs[i]->len - wst);
+			if (cnt <= 0) {
+				continue;
+			}
+			windows_total++;
+
+			PROF_START(t_fft);
+			initCA(win, wlen, 0);
+			copyCA(ins->carrs[i], wst, win, 0, cnt);
+			win->len = wlen;
+			re = fft(win);
+			PROF_STOP(PROF_FFT, t_fft);
+
+			/* Window with the old knobs is faded out */
+			old = NULL;
+			if (fade) {
+				mod = allocCA(re->len);
+				copyCA(re, 0, mod, 0, re->len);
+				applyGains(prev, mod);
+				old = ifft(mod);
+				freeCA(mod);
+			}
+			PROF_START(t_modifs);
+			applyGains(gains, re);
+			PROF_STOP(PROF_MODIFS, t_modifs);
+
+			PROF_START(t_ifft);
+			ire = ifft(re);
+			PROF_STOP(PROF_IFFT, t_ifft);
+			for (j=0; j<cnt; j++) {
+				double r = (old != NULL) ? (j + 0.5)/cnt : 1.0;
+				double v = r*ire->c[j].re + ((old != NULL) ? (1.0 - r)*old->c[j].re : 0.0);
+				setCA(outs->carrs[i], wst + j, v, 0.0);
+			}
+
+			freeCA(ire); freeCA(re);
+			if (old != NULL) {
+				freeCA(old);
+			}
+		}
+		prev = gains;
+		if (done != NULL) {
+			done(ctx);
+		}
+	}
+	for (i=0; i < ins->len; i++) {
+		outs->carrs[i]->len = ins->carrs[i]->len;
+	}
+
+	freeCA(win);
+
+	return changes;
+}
+
+/*
+ *  Copies channel "c" of block "blk" with "ch" interleaved channels into
+ *   window "win" of "frames" samples.
+ */
+static void blockChannel(float *blk, int ch, int c, int frames, C_ARRAY *win) {
+	int f;
+	for (f=0; f<frames; f++) {
+		setCA(win, f, blk[f*ch + c], 0.0);
+	}
+	win->len = frames;
 }
 
 /*
- *  Free allocated space on heap by b_modif structure
+ *  Modifies channel "c" of block "blk" in place by response curve "gains",
+ *   "win" already contains the channel.
  */
-void freeModifs(struct b_modif *head) {
-	struct b_modif *prev, *pom;
-	pom = head;
-	while (pom != NULL) {
-		prev = pom;
-		pom = pom->next;
-		free(prev);
+static void shmWindow(float *blk, int ch, int c, C_ARRAY *win, double *gains) {
+	PROF_START(t_fft);
+	C_ARRAY *re = fft(win);
+	PROF_STOP(PROF_FFT, t_fft);
+	PROF_START(t_modifs);
+	applyGains(gains, re);
+	PROF_STOP(PROF_MODIFS, t_modifs);
+	PROF_START(t_ifft);
+	C_ARRAY *ire = ifft(re);
+	PROF_STOP(PROF_IFFT, t_ifft);
+
+	int f;
+	for (f=0; f < win->len; f++) {
+		blk[f*ch + c] = ire->c[f].re;
+	}
+	freeCA(re); freeCA(ire);
+}
+
+/*
+ *  Attaches shared memory ring "name" and modifies its blocks in place
+ *   as soon as the producer writes them, until the producer finishes.
+ *   Every block is one window of fft engine, pairs of channels are
+ *   transformed together like by fftEnginePair. Returns 0 on success,
+ *   -1 if the ring cannot be attached.
+ */
+static int shmEngine(char *name, struct b_modif *modifs_head, struct octave *oct, double s_value) {
+	struct shm_ring *ring;
+	if ((ring = shmAttach(name)) == NULL) {
+		return -1;
+	}
+	struct shm_header *hdr = ring->hdr;
+	int wlen = hdr->frames, ch = hdr->channels;
+	printf("Ring \"%s\": %d channels, %dHz, %d blocks of %d frames\n", name, ch, hdr->srate, hdr->blocks, wlen);
+
+	double *gains = compileGains(modifs_head, oct, wlen, hdr->srate);
+	silence_level = silenceLevel(s_value, maxGain(gains, wlen));
+	silence_gain = broadbandGain(gains, wlen);
+	C_ARRAY *win1 = allocCA(wlen), *win2 = allocCA(wlen), *pack = allocCA(wlen);
+	C_ARRAY *re1, *re2, *ire;
+
+	uint32_t tail = SHM_COUNT(__atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE));
+	uint32_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	long blocks = 0;
+	for (;;) {
+		while (SHM_COUNT(head) == tail && !(head & SHM_EOF)) {
+			head = shmWait(&hdr->head, head);
+		}
+		if (SHM_COUNT(head) == tail) {
+			break;
+		}
+
+		float *blk = shmBlock(ring, tail);
+		int c, f;
+		for (c=0; c<ch; c += 2) {
+			blockChannel(blk, ch, c, wlen, win1);
+			int silent1 = isSilent(win1, 0, wlen), silent2 = 1;
+			if (c + 1 < ch) {
+				blockChannel(blk, ch, c + 1, wlen, win2);
+				silent2 = isSilent(win2, 0, wlen);
+				windows_total++;
+			}
+			windows_total++;
+			windows_skipped += silent1 + (c + 1 < ch && silent2);
+
+			/* Silent channels only follow broadband gain of the knobs */
+			for (f=0; f<wlen; f++) {
+				if (silent1) {
+					blk[f*ch + c] *= silence_gain;
+				}
+				if (c + 1 < ch && silent2) {
+					blk[f*ch + c + 1] *= silence_gain;
+				}
+			}
+			if (!silent1 && !silent2) {
+				for (f=0; f<wlen; f++) {
+					setCA(pack, f, win1->c[f].re, win2->c[f].re);
+				}
+				pack->len = wlen;
+				PROF_START(t_fft);
+				fftPair(pack, &re1, &re2);
+				PROF_STOP(PROF_FFT, t_fft);
+				PROF_START(t_modifs);
+				applyGains(gains, re1);
+				applyGains(gains, re2);
+				PROF_STOP(PROF_MODIFS, t_modifs);
+				PROF_START(t_ifft);
+				ire = ifftPair(re1, re2);
+				PROF_STOP(PROF_IFFT, t_ifft);
+				for (f=0; f<wlen; f++) {
+					blk[f*ch + c] = ire->c[f].re;
+					blk[f*ch + c + 1] = ire->c[f].im;
+				}
+				freeCA(re1); freeCA(re2); freeCA(ire);
+			} else if (!silent1) {
+				shmWindow(blk, ch, c, win1, gains);
+			} else if (!silent2) {
+				shmWindow(blk, ch, c + 1, win2, gains);
+			}
+		}
+		shmAdvance(&hdr->tail);
+		tail = SHM_COUNT(tail + 1);
+		blocks++;
+	}
+	shmFinish(&hdr->tail);
+	printf("Processed %ld blocks (%llu frames), skipped %d of %d windows\n", blocks, (unsigned long long) hdr->total, windows_skipped, windows_total);
+
+	freeCA(win1); freeCA(win2); freeCA(pack);
+	free(gains);
+	shmClose(ring);
+
+	return 0;
+}
+
+/*
+ *  Designs FIR filter from all modifications and applies it on the whole
+ *   input track "in" at once, result is stored in "out".
+ */
+static void firEngine(C_ARRAY *in, C_ARRAY *out, C_ARRAY *fir, int delay, int block) {
+	C_ARRAY *res = (block > 0) ? convolvePartitioned(in, fir, delay, block) : convolveOS(in, fir, delay);
+	copyCA(res, 0, out, 0, in->len);
+	freeCA(res);
+}
+
+/*
+ *  Splits input track "in" into octaves by multirate filter bank, applies
+ *   all modifications on each octave in its own sample rate and stores
+ *   the resynthesized result in "out".
+ */
+static void bankEngine(C_ARRAY *in, C_ARRAY *out, struct b_modif *modifs_head, struct octave *oct, int srate) {
+	C_ARRAY *res = filterBank(in, modifs_head, oct, srate, BANK_WLEN);
+	copyCA(res, 0, out, 0, in->len);
+	freeCA(res);
+}
+
+/*
+ *  Splits spectrum of input track "in" into regions, applies all
+ *   modifications on each region with its own window length and stores
+ *   sum of the modified regions in "out".
+ */
+static void multiresEngine(C_ARRAY *in, C_ARRAY *out, struct b_modif *modifs_head, struct octave *oct, int srate) {
+	C_ARRAY *res = multiRes(in, modifs_head, oct, srate);
+	copyCA(res, 0, out, 0, in->len);
+	freeCA(res);
+}
+
+/*
+ *  Returns newly allocated name of output file of preset "name", which is
+ *   "out_file" with "_name" added before its extension.
+ */
+static char *presetFileName(char *out_file, char *name) {
+	char *pfile;
+	if ((pfile = (char *) malloc(strlen(out_file) + strlen(name) + 2)) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	char *dot = strrchr(out_file, '.');
+	if (dot == NULL || strchr(dot, '/') != NULL) {
+		dot = out_file + strlen(out_file);
+	}
+	sprintf(pfile, "%.*s_%s%s", (int) (dot - out_file), out_file, name, dot);
+
+	return pfile;
+}
+
+/*
+ *  Returns number of samples, which have to be read before and after
+ *   selected part of the input, so that "engine" gives the same result
+ *   as for the whole track. Windows of fft engine are independent, FIR
+ *   filter reaches "taps" samples, other engines remember much longer.
+ */
+static int rangeMargin(enum engine engine, int taps) {
+	switch (engine) {
+		case ENGINE_FFT:
+			return 0;
+		case ENGINE_FIR:
+			return taps;
+		default:
+			return RANGE_MARGIN;
+	}
+}
+
+/*
+ *  Returns length, which segments of worker processes are aligned to, so
+ *   that all windows of "engine" stay at the same positions as in the
+ *   whole track. Every level of filter bank has its own windows.
+ */
+static int segmentAlign(enum engine engine, int srate, int wlen) {
+	switch (engine) {
+		case ENGINE_BANK:
+			return BANK_WLEN << bankLevels(srate);
+		case ENGINE_MULTIRES:
+			return MR_MAX_WLEN;
+		default:
+			return wlen;
+	}
+}
+
+/*
+ *  Returns margin around segments of worker processes, it is multiple
+ *   of "align". Windows of filter bank and of multires engine see the
+ *   input through decimation filters, so whole window at the edge of
+ *   the segment is affected by them and one more window is needed.
+ */
+static int segmentMargin(enum engine engine, int taps, int align) {
+	int margin = (rangeMargin(engine, taps) + align - 1)/align*align;
+	if (engine == ENGINE_BANK || engine == ENGINE_MULTIRES) {
+		margin += align;
+	}
+
+	return margin;
+}
+
+/*
+ *  Everything, what worker process needs for modifying its segment.
+ */
+struct seg_ctx {
+	enum engine engine;
+	struct b_modif *modifs_head;
+	struct octave *oct;
+	int srate;
+	int wlen;
+	C_ARRAY *fir;           /* Filter of fir engine, designed before the workers start */
+	int fir_delay;
+	int block;              /* Block of partitioned convolution, 0 if not used */
+};
+
+/*
+ *  Modifies all channels of one segment by selected engine like the main
+ *   loop does for the whole track, it is called by worker processes.
+ */
+static void segmentEngine(C_ARRS *ins, C_ARRS *outs, void *ctx) {
+	struct seg_ctx *sc = (struct seg_ctx *) ctx;
+
+	if (sc->engine == ENGINE_BIQUAD) {
+		int bq_count;
+		struct biquad *bqs = designBiquads(sc->modifs_head, sc->oct, sc->srate, &bq_count);
+		biquadCascade(ins, outs, bqs, bq_count);
+		free(bqs);
+		return;
+	}
+
+	double *x = allocDoubles(sc->wlen);
+	double *y = allocDoubles(sc->wlen);
+	int i;
+	for (i=0; i < ins->len; i++) {
+		switch (sc->engine) {
+			case ENGINE_FIR:
+				firEngine(ins->carrs[i], outs->carrs[i], sc->fir, sc->fir_delay, sc->block);
+				break;
+			case ENGINE_BANK:
+				bankEngine(ins->carrs[i], outs->carrs[i], sc->modifs_head, sc->oct, sc->srate);
+				break;
+			case ENGINE_MULTIRES:
+				multiresEngine(ins->carrs[i], outs->carrs[i], sc->modifs_head, sc->oct, sc->srate);
+				break;
+			default:
+				/* Channels of one segment have the same length */
+				if (i % 2 == 0 && i + 1 < ins->len) {
+					fftEnginePair(ins->carrs[i], ins->carrs[i+1], outs->carrs[i], outs->carrs[i+1], sc->modifs_head, sc->oct, sc->srate, sc->wlen, NULL, i, x, y);
+				} else if (i % 2 == 0) {
+					fftEngine(ins->carrs[i], outs->carrs[i], sc->modifs_head, sc->oct, sc->srate, sc->wlen, NULL, i, x, y);
+				}
+				break;
+		}
+	}
+	free(x); free(y);
+}
+
+/*
+ *  Common end of all modes: prints summary of the measured stages (also
+ *   into report "p_value", unless it is "-") and keeps FFT kernels
+ *   measured in this run in wisdom file "W_value" for the next ones.
+ */
+static void finishRun(char *p_value, char *W_value) {
+	if (prof_enabled) {
+		printf("\nDuration of the stages:\n");
+		profReport(stdout);
+		if (strcmp(p_value, "-") != 0 && profWriteReport(p_value) == 0) {
+			printf("Timing report written to \"%s\"\n", p_value);
+		}
+	}
+
+	if (newWisdom() && saveWisdom(W_value) == 0) {
+		log_out(55, "FFT wisdom written to \"%s\"\n", W_value);
 	}
 }
 
@@ -397,15 +1104,69 @@ int main(int argc, char **argv) {
 	int w_flag=0;	/* Treat input as file in WAV format */
 	int o_flag=0;   /* Write output to file out_file */
 	int r_flag=0;   /* Set Octave fraction, default is Octave [1/1] */
-	int k_flag=0;   /* Settings of virtual knots */
+	int k_flag=0;   /* Number of settings of virtual knots */
+	int m_flag=0;   /* Design minimum phase FIR filter */
 	int r_value=1;  /* Fraction denominator value, default is 1 */
-	char *k_value;  /* Settings of virtual knots */
-	char *in_file;  /* Name of input file (if f_flag==1) */
-	char *out_file; /* Name of output file (if o_flag==1) */
+	int t_value=DEFAULT_TAPS; /* Number of FIR filter coefficients */
+	int b_value=0;  /* Block length of partitioned convolution, 0 if not used */
+	int S_flag=0;   /* Compute spectrum of whole channels */
+	int l_value=DEFAULT_WLEN; /* Window length of FFT engine */
+	int H_flag=0;   /* Store cached spectra as float16 */
+	int I_flag=0;   /* Run interactive server */
+	double s_value=DEFAULT_SILENCE; /* Silence level in dBFS */
+	enum engine engine=ENGINE_FFT; /* Engine which applies modifications */
+	char *k_value = NULL; /* Settings of virtual knots */
+	char **k_values;      /* All settings of virtual knots, if "-k" was given more times */
+	char *P_value = NULL; /* Name of file with presets */
+	char *G_value = NULL; /* Groups of bands for stems */
+	char *L_value = NULL; /* File with live knobs */
+	char *A_value = NULL; /* File with automation of knobs */
+	char *M_value = NULL; /* Name of shared memory ring */
+	char *D_value = NULL; /* Spool directory of daemon */
+	int n_value = sysconf(_SC_NPROCESSORS_ONLN); /* Number of workers of daemon */
+	int X_value = 0;      /* Number of worker processes for segments, 0 if not used */
+	char *in_file = NULL; /* Name of input file (if f_flag==1) */
+	char *out_file = NULL; /* Name of output file (if o_flag==1) */
+	char *p_value = NULL; /* Name of file for timing report */
+	char *W_value = DEFAULT_WISDOM; /* Name of FFT wisdom file */
+	char *C_value = NULL; /* Directory of spectrum cache, NULL if not used */
+	char *U_value = NULL; /* Socket of interactive server */
+	double start_value = 0.0;     /* Start of processed part in seconds */
+	double duration_value = -1.0; /* Length of processed part, negative means till the end */
+	int range_flag = 0;           /* Only part of the input is processed */
+
+	if ((k_values = (char **) malloc(argc * sizeof(char *))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+
+	static struct option long_options[] = {
+		{"start", required_argument, NULL, OPT_START},
+		{"duration", required_argument, NULL, OPT_DURATION},
+		{NULL, 0, NULL, 0}
+	};
 
 	/* Read and process all options given to this program */
-	while ((opt = getopt(argc, argv, "f:wd:o:r:k:")) != -1) {
+	while ((opt = getopt_long(argc, argv, "f:wd:o:r:k:P:G:L:A:M:D:n:X:e:t:mb:s:p:aW:K:Sj:l:C:HIU:", long_options, NULL)) != -1) {
 		switch(opt) {
+			case OPT_START:
+				/* Start of processed part of the input */
+				range_flag = 1;
+				start_value = atof(optarg);
+				if (start_value < 0) {
+					fprintf(stderr, "Start must not be negative\n");
+					usage();
+				}
+				break;
+			case OPT_DURATION:
+				/* Length of processed part of the input */
+				range_flag = 1;
+				duration_value = atof(optarg);
+				if (duration_value <= 0) {
+					fprintf(stderr, "Duration must be positive\n");
+					usage();
+				}
+				break;
 			case 'f':
 				if (f_flag != 0) {
 					fprintf(stderr, "Only one input file is required\n");
@@ -439,13 +1200,148 @@ int main(int argc, char **argv) {
 				r_value = atoi(optarg);
 				break;
 			case 'k':
-				if (k_flag != 0) {
-					fprintf(stderr, "Only one set of virtual knots configuration is allowed\n");
+				/* Prepare modification functions, more of them are rendered as presets */
+				k_values[k_flag++] = optarg;
+				k_value = k_values[0];
+				break;
+			case 'P':
+				/* Read named presets from file */
+				P_value = optarg;
+				break;
+			case 'M':
+				/* Modify blocks of shared memory ring */
+				M_value = optarg;
+				break;
+			case 'D':
+				/* Process jobs from spool directory */
+				D_value = optarg;
+				break;
+			case 'n':
+				n_value = atoi(optarg);
+				if (n_value < 1) {
+					fprintf(stderr, "Number of workers must be positive\n");
 					usage();
 				}
-				/* Prepare modification functions */
-				k_flag = 1;
-				k_value = optarg;
+				break;
+			case 'X':
+				/* Split input among worker processes */
+				X_value = atoi(optarg);
+				if (X_value < 1) {
+					fprintf(stderr, "Number of worker processes must be positive\n");
+					usage();
+				}
+				break;
+			case 'A':
+				/* Change knobs in time */
+				A_value = optarg;
+				break;
+			case 'L':
+				/* Watch file with knobs during processing */
+				L_value = optarg;
+				break;
+			case 'G':
+				/* Split input into stems by groups of bands */
+				G_value = optarg;
+				break;
+			case 'e':
+				/* Select engine by its name */
+				if (strcmp(optarg, "fft") == 0) {
+					engine = ENGINE_FFT;
+				} else if (strcmp(optarg, "fir") == 0) {
+					engine = ENGINE_FIR;
+				} else if (strcmp(optarg, "biquad") == 0) {
+					engine = ENGINE_BIQUAD;
+				} else if (strcmp(optarg, "bank") == 0) {
+					engine = ENGINE_BANK;
+				} else if (strcmp(optarg, "multires") == 0) {
+					engine = ENGINE_MULTIRES;
+				} else {
+					fprintf(stderr, "Unknown engine \"%s\"\n", optarg);
+					usage();
+				}
+				break;
+			case 't':
+				/* Set number of FIR filter coefficients */
+				t_value = atoi(optarg);
+				if (t_value < 3 || t_value > 65535) {
+					fprintf(stderr, "Number of taps is out of range [3; 65535]\n");
+					usage();
+				}
+				break;
+			case 'm':
+				/* Use minimum phase FIR filter */
+				m_flag = 1;
+				break;
+			case 'b':
+				/* Use partitioned convolution */
+				b_value = atoi(optarg);
+				if (b_value < 2 || b_value > 65536 || !is_pow_of_2(b_value)) {
+					fprintf(stderr, "Block length must be power of 2 in range [2; 65536]\n");
+					usage();
+				}
+				break;
+			case 's':
+				/* Set silence level */
+				s_value = atof(optarg);
+				break;
+			case 'p':
+				/* Turn on timing of all stages */
+				p_value = optarg;
+				prof_enabled = 1;
+				break;
+			case 'W':
+				/* Set FFT wisdom file */
+				W_value = optarg;
+				break;
+			case 'K':
+				/* Force FFT kernel */
+				if ((forced_kernel = kernelByName(optarg)) < 0) {
+					fprintf(stderr, "Unknown FFT kernel \"%s\"\n", optarg);
+					usage();
+				}
+				break;
+			case 'S':
+				/* Compute spectrum of whole channels */
+				S_flag = 1;
+				break;
+			case 'C':
+				/* Keep spectra of windows in cache directory */
+				C_value = optarg;
+				break;
+			case 'H':
+				/* Cached spectra in half precision */
+				H_flag = 1;
+				break;
+			case 'I':
+				/* Serve commands from the standard input */
+				I_flag = 1;
+				break;
+			case 'U':
+				/* Serve commands from clients of UNIX socket */
+				I_flag = 1;
+				U_value = optarg;
+				break;
+			case 'j':
+				/* Set number of FFT threads */
+				fft_threads = atoi(optarg);
+				if (fft_threads < 1) {
+					fprintf(stderr, "Number of threads must be positive\n");
+					usage();
+				}
+				break;
+			case 'l':
+				/* Set window length of FFT engine */
+				l_value = atoi(optarg);
+				if (l_value < MIN_WLEN || l_value > MAX_WLEN) {
+					fprintf(stderr, "Window length must be in range [%d; %d]\n", MIN_WLEN, MAX_WLEN);
+					usage();
+				}
+				break;
+			case 'a':
+				/* Print debugging messages by logger thread */
+				if (logStart() != 0) {
+					exit (ERROR_EXIT_CODE);
+				}
 				break;
 			case '?':
 				usage();
@@ -453,26 +1349,119 @@ int main(int argc, char **argv) {
 		}
 	}
 
-	/* "in_file" is required argument */
-	if (f_flag == 0) {
+	/* "in_file" is required argument, unless samples come from shared memory or spool */
+	if (f_flag == 0 && M_value == NULL && D_value == NULL) {
 		fprintf(stderr, "Argument in_file is required\n");
 		usage();
 	}
+	if (range_flag != 0 && w_flag == 0) {
+		fprintf(stderr, "Options --start and --duration need WAV input\n");
+		usage();
+	}
+	if (I_flag != 0 && w_flag == 0) {
+		fprintf(stderr, "Interactive server needs WAV input\n");
+		usage();
+	}
+	if (H_flag != 0 && C_value == NULL) {
+		fprintf(stderr, "Option -H needs spectrum cache (-C dir)\n");
+		usage();
+	}
+	if (G_value != NULL && (k_flag != 0 || P_value != NULL)) {
+		fprintf(stderr, "Stems cannot be combined with knobs\n");
+		usage();
+	}
+	if (L_value != NULL && (engine != ENGINE_FFT || I_flag != 0 || k_flag > 1 || P_value != NULL || G_value != NULL)) {
+		fprintf(stderr, "Live knobs can be used only by fft engine with one set of knobs\n");
+		usage();
+	}
+	/* Presets and stems share spectra of windows, which only fft engine has */
+	int preset_mode = (k_flag > 1 || P_value != NULL || G_value != NULL);
+	if (preset_mode && (engine != ENGINE_FFT || I_flag != 0)) {
+		fprintf(stderr, "More presets can be rendered only by fft engine and not by server\n");
+		usage();
+	}
+	if (A_value != NULL && (engine != ENGINE_FFT || I_flag != 0 || preset_mode || L_value != NULL)) {
+		fprintf(stderr, "Automation can be used only by fft engine with one set of knobs\n");
+		usage();
+	}
+	if (M_value != NULL && (f_flag != 0 || engine != ENGINE_FFT || I_flag != 0 || preset_mode || L_value != NULL || A_value != NULL || range_flag != 0)) {
+		fprintf(stderr, "Shared memory ring can be used only instead of in_file by fft engine with one set of knobs\n");
+		usage();
+	}
+	/* Timing report is not shared by more threads */
+	if (D_value != NULL && (f_flag != 0 || M_value != NULL || engine != ENGINE_FFT || I_flag != 0 || preset_mode || L_value != NULL || A_value != NULL || range_flag != 0 || p_value != NULL)) {
+		fprintf(stderr, "Daemon can be used only instead of in_file by fft engine with one set of knobs and without timing report\n");
+		usage();
+	}
+	/* Segments need channels of the same length, stages of workers are not measured */
+	if (X_value > 0 && (w_flag == 0 || M_value != NULL || D_value != NULL || I_flag != 0 || preset_mode || L_value != NULL || A_value != NULL || C_value != NULL || range_flag != 0 || p_value != NULL)) {
+		fprintf(stderr, "Worker processes need WAV input and one set of knobs, without cache, time range and timing report\n");
+		usage();
+	}
+
+	/* Kernels already measured on this machine, missing file is not an error */
+	if (strcmp(W_value, "-") == 0) {
+		plan_mode = PLAN_ESTIMATE;
+	} else {
+		loadWisdom(W_value);
+	}
 
 	/*
 	 *  Stores all information from given WAV file header
 	 */
-	ELEMENT *header;
-
+	ELEMENT *header = NULL;
+	/* Sample rate of the input data */
+	int srate = DEFAULT_SRATE;
+	/* Selected part of WAV input, read part starts "range_skip" samples before it */
+	long range_first = 0, range_count = 0, range_skip = 0;
+
+	/* Samples are not read, they come block by block through shared memory */
+	if (M_value != NULL) {
+		printf("Processing blocks of shared memory ring \"%s\"\n", M_value);
+	}
+	/* Every job of daemon is read by its worker */
+	else if (D_value != NULL) {
+		printf("Processing jobs of spool directory \"%s\"\n", D_value);
+	}
 	/* "w_flag" was not set, read "in_file" as raw input data (default) */
-	if (w_flag == 0) {
+	else if (w_flag == 0) {
 		printf("Reading raw data from file \"%s\"...\n", in_file);
+		PROF_START(t_read);
 		readInput(ins, in_file);
+		PROF_STOP(PROF_READ, t_read);
 	}
 	/* "w_flag" was set, read in_file as WAV */
 	else {
 		printf("Reading wav input file from \"%s\"...\n", in_file);
-		header = readWav(ins, in_file);
+		if (range_flag) {
+			/* Sample rate is needed to find the part in the data block */
+			if ((header = readWavHeader(in_file)) == NULL) {
+				exit (ERROR_EXIT_CODE);
+			}
+			srate = getSampleRate(header);
+			long total = getSubchunk2Size(header)/(getNumChannels(header)*(getBitsPerSample(header)/8));
+			freeHeader(header);
+
+			range_first = MIN((long) (start_value*srate), total);
+			range_count = (duration_value < 0) ? total - range_first : MIN((long) (duration_value*srate), total - range_first);
+			/* Windows of fft engine have to be the same as in the whole track */
+			int margin = rangeMargin(engine, t_value);
+			long first = MAX(range_first/l_value*l_value - margin, 0);
+			long last = MIN((range_first + range_count + l_value - 1)/l_value*l_value + margin, total);
+			range_skip = range_first - first;
+			if (range_count <= 0) {
+				fprintf(stderr, "Selected part is after the end of input\n");
+				exit (ERROR_EXIT_CODE);
+			}
+			printf("Processing samples from %ld to %ld, reading from %ld to %ld\n", range_first, range_first + range_count, first, last);
+			header = readWavRange(ins, in_file, first, last - first);
+		} else {
+			header = readWav(ins, in_file);
+		}
+		if (header == NULL) {
+			exit (ERROR_EXIT_CODE);
+		}
+		srate = getSampleRate(header);
 	}
 	/* Now when we know the number of input samples/channels, lets allocate output */
 	outs = allocCAS(ins->len);
@@ -501,18 +1490,204 @@ int main(int argc, char **argv) {
 	modifs_head = NULL;
 
 	/* Parse input virtual knots configuration */
-	if (k_flag != 0) {
-		modifs_head = initModifs(modifs_head, oct, k_value);
+	if (!preset_mode && k_flag != 0 && initModifs(&modifs_head, oct, k_value) != 0) {
+		usage();
+	}
+
+	/*
+	 *  Named presets, all of them are rendered from the same spectra,
+	 *   knobs given by "-k" are named by their order.
+	 */
+	struct preset *presets = NULL, *pr;
+	int preset_count = 1; /* Number of rendered outputs */
+	if (preset_mode) {
+		int k;
+		for (k=0; k < k_flag; k++) {
+			char pname[16];
+			sprintf(pname, "%d", k+1);
+			if ((presets = addPreset(presets, oct, pname, k_values[k])) == NULL) {
+				usage();
+			}
+		}
+		if (P_value != NULL) {
+			int loaded = loadPresets(&presets, oct, P_value);
+			if (loaded < 0) {
+				exit (ERROR_EXIT_CODE);
+			}
+			if (loaded == 0) {
+				fprintf(stderr, "No presets in \"%s\"\n", P_value);
+				exit (ERROR_EXIT_CODE);
+			}
+		}
+		if (G_value != NULL && (presets = addStems(presets, oct, G_value)) == NULL) {
+			usage();
+		}
+		for (preset_count=0, pr=presets; pr != NULL; pr=pr->next) {
+			preset_count++;
+		}
+		printf("Rendering %d %s from one analysis\n", preset_count, (G_value != NULL) ? "stems" : "presets");
+	}
+
+	/* Producer of the ring decides when the processing ends */
+	if (M_value != NULL) {
+		int ret = shmEngine(M_value, modifs_head, oct, s_value);
+		finishRun(p_value, W_value);
+		freePlans();
+		freeModifs(modifs_head);
+		freeOctave(oct);
+		freeCAS(ins);
+		freeCAS(outs);
+		return (ret == 0) ? 0 : ERROR_EXIT_CODE;
+	}
+
+	/* Daemon runs until it is stopped by signal */
+	if (D_value != NULL) {
+		int ret = runDaemon(D_value, oct, l_value, n_value, k_value, s_value);
+		finishRun(p_value, W_value);
+		freePlans();
+		freeModifs(modifs_head);
+		freeOctave(oct);
+		freeCAS(ins);
+		freeCAS(outs);
+		return (ret == 0) ? 0 : ERROR_EXIT_CODE;
+	}
+
+	/* Server keeps the spectra in memory and renders only on request */
+	if (I_flag != 0) {
+		int ret = runServer(ins, header, oct, l_value, k_value, U_value);
+		finishRun(p_value, W_value);
+		freePlans();
+		freeModifs(modifs_head);
+		freeOctave(oct);
+		freeCAS(ins);
+		freeCAS(outs);
+		return (ret == 0) ? 0 : ERROR_EXIT_CODE;
 	}
 
+	/*
+	 *  If the knobs do not change anything, the whole input is copied,
+	 *   otherwise silence level is lowered by the highest gain, so that
+	 *   skipped windows would stay silent even after modification.
+	 */
+	int bypass;
+	double max_gain;
+	struct live_knobs *live = NULL;
+	struct automation *au = NULL;
+	if (A_value != NULL) {
+		/* Gains change in time, so nothing can be skipped */
+		au = loadAutomation(A_value, oct, l_value, srate, compileGains(modifs_head, oct, l_value, srate));
+		if (au == NULL) {
+			exit (ERROR_EXIT_CODE);
+		}
+		bypass = 0;
+		max_gain = HUGE_VAL;
+	} else if (L_value != NULL) {
+		/* Knobs can change at any time, so nothing can be skipped */
+		live = liveStart(L_value, oct, l_value, srate, compileGains(modifs_head, oct, l_value, srate));
+		if (live == NULL) {
+			exit (ERROR_EXIT_CODE);
+		}
+		bypass = 0;
+		max_gain = HUGE_VAL;
+	} else if (presets == NULL) {
+		double *gains = compileGains(modifs_head, oct, l_value, srate);
+		bypass = isIdentity(gains, l_value);
+		max_gain = maxGain(gains, l_value);
+		silence_gain = broadbandGain(gains, l_value);
+		free(gains);
+	} else if (G_value != NULL) {
+		/* Silent window copied into every stem would not sum back to the input */
+		compileStems(presets, oct, l_value, srate);
+		bypass = 0;
+		max_gain = HUGE_VAL;
+	} else {
+		/* Window is skipped only if it stays silent in all presets */
+		bypass = 1;
+		max_gain = 0.0;
+		for (pr=presets; pr != NULL; pr=pr->next) {
+			pr->gains = compileGains(pr->modifs, oct, l_value, srate);
+			bypass = bypass && isIdentity(pr->gains, l_value);
+			max_gain = MAX(max_gain, maxGain(pr->gains, l_value));
+			pr->broadband = broadbandGain(pr->gains, l_value);
+		}
+	}
+	if (bypass) {
+		printf("Knobs do not modify anything, input will be copied\n");
+	}
+	silence_level = silenceLevel(s_value, max_gain);
+
+	/* FIR filter is the same for all channels, design it only once */
+	C_ARRAY *fir = NULL;
+	int fir_delay = 0;
+	if (engine == ENGINE_FIR && !bypass) {
+		fir = designFIR(modifs_head, oct, srate, t_value, m_flag);
+		fir_delay = firDelay(fir, m_flag);
+		printf("Using FIR filter with %d taps and delay of %d samples\n", fir->len, fir_delay);
+	}
 	
 	printf("Got %d input samples\n", ins->len);
 
+	/* Allocate all output channels, the first preset is rendered into "outs" */
+	for (outs->len=0; outs->len < ins->len; outs->len++) {
+		outs->carrs[outs->len] = allocCA(ins->carrs[outs->len]->len);
+	}
+	C_ARRS **pouts;  /* Output channels of every preset */
+	if ((pouts = (C_ARRS **) malloc(preset_count * sizeof(C_ARRS *))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	pouts[0] = outs;
+	int p_i;
+	for (p_i=1; p_i < preset_count; p_i++) {
+		pouts[p_i] = allocCAS(ins->len);
+		for (pouts[p_i]->len=0; pouts[p_i]->len < ins->len; pouts[p_i]->len++) {
+			pouts[p_i]->carrs[pouts[p_i]->len] = allocCA(ins->carrs[pouts[p_i]->len]->len);
+		}
+	}
+
+	/* Spectra of all windows are computed only once for the same input */
+	struct spec_cache *cache = NULL;
+	if (C_value != NULL && engine == ENGINE_FFT && !bypass && live == NULL && au == NULL) {
+		cache = openSpecCache(C_value, ins, l_value, H_flag);
+		if (cache != NULL && !cache->hit) {
+			fillSpecCache(cache, ins);
+		}
+		if (cache != NULL) {
+			printf("Spectra of windows %s cache \"%s\"\n", cache->hit ? "taken from" : "stored into", cache->path);
+		}
+	}
+
+	/* Live knobs change at the same time in all channels */
+	if (live != NULL) {
+		int changes = curveEngine(ins, outs, l_value, liveCurve, liveDone, live);
+		printf("Knobs changed %d times during processing\n", changes);
+		liveStop(live);
+	}
+	if (au != NULL) {
+		struct auto_pos ap = {au, 0};
+		curveEngine(ins, outs, l_value, automationAt, NULL, &ap);
+		printf("Automation computed %ld bins in %ld windows, %.1f per window of %d\n", au->updated, au->windows, (double) au->updated/MAX(au->windows, 1), l_value/2 + 1);
+	}
+
+	/* Every worker process modifies its own segment of all channels */
+	if (X_value > 0 && !bypass) {
+		struct seg_ctx sc = {engine, modifs_head, oct, srate, l_value, fir, fir_delay, b_value};
+		int align = segmentAlign(engine, srate, l_value);
+		if (runSegments(ins, outs, X_value, align, segmentMargin(engine, t_value, align), segmentEngine, &sc) != 0) {
+			exit (ERROR_EXIT_CODE);
+		}
+	}
+
+	/* Biquad cascade filters all channels together */
+	if (engine == ENGINE_BIQUAD && !bypass && X_value == 0) {
+		int bq_count;
+		struct biquad *bqs = designBiquads(modifs_head, oct, srate, &bq_count);
+		printf("Using cascade of %d biquads\n", bq_count);
+		biquadCascade(ins, outs, bqs, bq_count);
+		free(bqs);
+	}
+
 	gnuplot_ctrl * g;
-	C_ARRAY *re, *ire;  /* For temporary storing FFT and IFFT results */
-	C_ARRAY *win;       /* Window for WLEN samples, works as kind of buffer */
-	win = allocCA(WLEN);
-	//C_ARRAY *wav_out;
 
 
 	/*
@@ -525,6 +1700,11 @@ int main(int argc, char **argv) {
 	 *   iii) apply all modification selected by user,
 	 *   iv)  transfer through IFFT each window back,
 	 *   v)   connect all windows together into the result
+	 *  or, if FIR engine was selected, convolve the whole channel
+	 *   with the designed filter, or split it into octaves by filter
+	 *   bank (or into regions with their own window lengths) and modify
+	 *   every part separately. Biquad engine has already filtered
+	 *   all channels before this loop.
 	 */
 	int i; /* Current sound track id */
 	for (i=0; i < ins->len; i++) {
@@ -532,11 +1712,13 @@ int main(int argc, char **argv) {
 		int ilen2 = get_pow(ilen, 2);
 		int imax = ins->carrs[i]->max;
 		int j; /* For iteration through all points in graph */
-		double *x = allocDoubles(imax);
-		double *y = allocDoubles(imax);
+		/* Spectrum of one window can be longer than short input */
+		double *x = allocDoubles(MAX(imax, l_value));
+		double *y = allocDoubles(MAX(imax, l_value));
 
 		printf("INPUT %d, #samples: %d length->^2: %d:\n", i+1, ilen, ilen2);
 
+		PROF_START(t_iplot);
 		g = gnuplot_init();
 		gnuplot_cmd(g, "set terminal png");
 		gnuplot_setstyle(g, "lines");
@@ -547,6 +1729,7 @@ int main(int argc, char **argv) {
 		}
 		gnuplot_plot_xy(g, x, y, ilen, "Input");
 		gnuplot_close(g);
+		PROF_STOP(PROF_PLOT, t_iplot);
 
 		/* Write input data as raw data in GNU Octave/Matlab-like format */
 		STRING fname = alloc_string(20);
@@ -554,68 +1737,80 @@ int main(int argc, char **argv) {
 		writeOutput(fname.text, ins->carrs[i]);
 		free_string(&fname);
 
+		/* Spectrum of the whole channel, only the first half is unique */
+		if (S_flag) {
+			unsigned long long t0 = profNow();
+			C_ARRAY *spec = fft(ins->carrs[i]);
+			printf("Spectrum of %d points computed in %.3fs\n", spec->len, (profNow() - t0)*1e-9);
+			spec->len /= 2;
+			STRING sname = alloc_string(20);
+			sprintf(sname.text, "spectrum_%d.mat", i+1);
+			writeOutput(sname.text, spec);
+			free_string(&sname);
+			freeCA(spec);
+		}
+
 
 		/*
-		 *  Divide input samples into windows of specific length
+		 *  Apply the modifications using selected engine
 		 */
-		outs->carrs[i] = allocCA(ilen);
-		int win_num = (int) ceil(ilen/WLEN);
-		log_out(45, "Total number of windows is %d\n", win_num);
-		log_out(71, "\n");
-		int w_i;
-		for (w_i=0; w_i < win_num; w_i++) {
-			log_out(55, "Processing %d. window:\n", w_i+1);
-			/* Copy data from input track into new window */
-			copyCA(ins->carrs[i], w_i*WLEN, win, 0, WLEN);
-			win->max = WLEN;
-			win->len = MIN(WLEN, ilen - w_i*WLEN);
-
-			/* Not actually used, window functions needs to handle overlapping */
-			/* 
-			 * hammingWindow(win, 0.53836, 0.46164);
-			 * planckWindow(win, 0.1);
-			 * tukeyWindow(win, 0.1);
-			 */
-
-			/* Transform sound to frequency domain */
-			re = fft(win);
-
-			/* Plot graph of decibel values of each frequency */
-			g = gnuplot_init();
-			gnuplot_cmd(g, "set terminal png");
-			gnuplot_setstyle(g, "lines");
-			gnuplot_cmd(g, "set output \"fft_window_%d.png\"", w_i+1);
-			gnuplot_set_ylabel(g, "dBPS");
-			gnuplot_set_xlabel(g, "frequency (Hz)");
-			for (j=0; j < re->len; j++) {
-				x[j] = j;
-				y[j] = decibel(re->c[j]); 
+		PROF_START(t_filter);
+		if (bypass) {
+			for (p_i=0; p_i < preset_count; p_i++) {
+				copyCA(ins->carrs[i], 0, pouts[p_i]->carrs[i], 0, ilen);
 			}
-			gnuplot_plot_xy(g, x, y, re->len/2, "FT");
-
-			/* Apply modifications */
-			processModifs(modifs_head, re, oct, getSampleRate(header));
-
-			/* Plot graph of modified values in decibel units */
-			gnuplot_cmd(g, "set terminal png");
-			gnuplot_setstyle(g, "lines");
-			gnuplot_cmd(g, "set output \"fft_window_%d.png\"", w_i+1);
-			for (j=0; j < re->len; j++) {
-				x[j] = j;
-				y[j] = decibel(re->c[j]); 
+			windows_total += (ilen + l_value - 1)/l_value;
+			windows_skipped += (ilen + l_value - 1)/l_value;
+		} else if (X_value > 0) {
+			/* All channels were already modified by worker processes */
+		} else switch (engine) {
+			case ENGINE_FIR:
+				firEngine(ins->carrs[i], outs->carrs[i], fir, fir_delay, b_value);
+				break;
+			case ENGINE_BIQUAD:
+				/* All channels were already filtered */
+				break;
+			case ENGINE_BANK:
+				bankEngine(ins->carrs[i], outs->carrs[i], modifs_head, oct, srate);
+				break;
+			case ENGINE_MULTIRES:
+				multiresEngine(ins->carrs[i], outs->carrs[i], modifs_head, oct, srate);
+				break;
+			default:
+				/* All channels were already modified with live or automated knobs */
+				if (live != NULL || au != NULL) {
+					break;
+				}
+				/* Even channel is transformed together with the next one of the same length */
+				if (i % 2 == 0 && i + 1 < ins->len && ins->carrs[i+1]->len == ilen) {
+					if (presets != NULL) {
+						presetEngine(ins->carrs[i], ins->carrs[i+1], presets, pouts, l_value, cache, i);
+					} else {
+						fftEnginePair(ins->carrs[i], ins->carrs[i+1], outs->carrs[i], outs->carrs[i+1], modifs_head, oct, srate, l_value, cache, i, x, y);
+					}
+				} else if (i % 2 == 0 || ins->carrs[i-1]->len != ilen) {
+					if (presets != NULL) {
+						presetEngine(ins->carrs[i], NULL, presets, pouts, l_value, cache, i);
+					} else {
+						fftEngine(ins->carrs[i], outs->carrs[i], modifs_head, oct, srate, l_value, cache, i, x, y);
+					}
+				}
+				break;
+		}
+		/* Stages of the fft engine are measured separately */
+		if (engine != ENGINE_FFT || bypass) {
+			PROF_STOP(PROF_FILTER, t_filter);
+		}
+		/* Samples read only for the edges are thrown away */
+		if (range_flag) {
+			for (p_i=0; p_i < preset_count; p_i++) {
+				copyCA(pouts[p_i]->carrs[i], range_skip, pouts[p_i]->carrs[i], 0, range_count);
+				pouts[p_i]->carrs[i]->len = range_count;
 			}
-			gnuplot_plot_xy(g, x, y, re->len/2, "FT-modif");
-			gnuplot_close(g);
-
-			/* Transform back to time domain */
-			ire = ifft(re);
-			/* Add new modified result to the end of the output array */
-			copyCA(ire, 0, outs->carrs[i], w_i*WLEN, MIN(WLEN, ilen - w_i*WLEN));
-
-			freeCA(ire); freeCA(re);
 		}
 
 		/* Plot the result sound file */
+		PROF_START(t_oplot);
 		g = gnuplot_init();
 		gnuplot_cmd(g, "set terminal png");
 		gnuplot_setstyle(g, "lines");
@@ -625,24 +1820,55 @@ int main(int argc, char **argv) {
 		}
 		gnuplot_plot_xy(g, x, y, outs->carrs[i]->len, "Invers");
 		gnuplot_close(g);
+		PROF_STOP(PROF_PLOT, t_oplot);
 		printf("\n\n");
 
-		outs->len++;
-
 		free(x); free(y);
 	}
+	if (windows_total > 0) {
+		printf("Skipped %d of %d windows\n", windows_skipped, windows_total);
+	}
+
 	/* Write input channels into WAV file if WAV was on input */
 	if (o_flag == 1) {
 		log_out(55, "Writing result into WAV sound file\n");
-		writeWav(header, outs, out_file);
+		if (range_flag) {
+			setDataSize(header, range_count);
+		}
+		if (presets == NULL) {
+			writeWav(header, outs, out_file);
+		}
+		for (pr=presets, p_i=0; pr != NULL; pr=pr->next, p_i++) {
+			char *pfile = presetFileName(out_file, pr->name);
+			printf("%s \"%s\" written to \"%s\"\n", pr->stem ? "Stem" : "Preset", pr->name, pfile);
+			writeWav(header, pouts[p_i], pfile);
+			free(pfile);
+		}
 	}
 
+	finishRun(p_value, W_value);
+
+	if (cache != NULL) {
+		closeSpecCache(cache);
+	}
+	freePlans();
 	freeModifs(modifs_head);
+	freePresets(presets);
+	if (au != NULL) {
+		freeAutomation(au);
+	}
+	for (p_i=1; p_i < preset_count; p_i++) {
+		freeCAS(pouts[p_i]);
+	}
+	free(pouts);
+	free(k_values);
 	if (w_flag != 0) {
 		freeHeader(header);
 	}
 	freeOctave(oct);
-	freeCA(win);
+	if (fir != NULL) {
+		freeCA(fir);
+	}
 	freeCAS(ins);
 	freeCAS(outs);
 
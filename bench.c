@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  bench.c
+ *
+ *    Description:  Benchmark of the main stages of band equalization.
+ *                  Measured are FFT and IFFT of sizes from 64 to 1M,
+ *                  application of modifications for every Octave fraction,
+ *                  window functions and reading/writing of synthetic WAV
+ *                  files. Every measurement is repeated, its median, minimum
+ *                  and standard deviation are printed out as a table and
+ *                  also written to JSON file, so that results of different
+ *                  releases can be compared.
+ *
+ *                  For further details about options see usage, e.g. by
+ *                  running ./benchmark -h.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+
+#include "my_std.h"
+#include "equalizer.h"
+#include "complex.h"
+#include "knobs.h"
+#include "wave.h"
+#include "fft.h"
+
+/* Size of the spectrum used for benchmark of modifications */
+#define MODIF_LEN (4096*2)
+/* Sample rate of the synthetic data */
+#define BENCH_SRATE 44100
+/* Length of the synthetic WAV file in seconds */
+#define WAV_SECONDS 10
+/* Default limits for repeating of one measurement */
+#define DEFAULT_REPEATS 7
+#define DEFAULT_MIN_TIME 0.05
+
+
+/* Stores the name of this program */
+char const *program_name;
+
+/* Number of measurements of every stage */
+static int repeats = DEFAULT_REPEATS;
+/* Minimal time (in seconds) of one measurement, short stages are looped */
+static double min_time = DEFAULT_MIN_TIME;
+/* File, where the results are written in JSON format */
+static FILE *json;
+/* Number of results already written to JSON file */
+static int json_count = 0;
+
+/*
+ *  Stage of the benchmark, function "run" is called "iters" times in
+ *   every measurement with given "arg".
+ */
+struct stage {
+	const char *name;       /* Name of the stage */
+	int param;              /* Size of the input or Octave fraction */
+	long samples;           /* # of samples processed by one call */
+	double flops;           /* # of floating point operations of one call, 0 if unknown */
+	void (*run)(void *arg); /* Measured function */
+	void *arg;              /* Argument passed to the function */
+};
+
+
+/*
+ *  Print out to the standard output information about usage of this program.
+ */
+static void usage(void) {
+	fprintf(stderr, "Usage: %s [-n repeats] [-t seconds] [-m max_size] [-s stage] [-o json_file] [-W wisdom]\n"
+		"   -n repeats: number of measurements of every stage, median is reported\n"
+		"        (default value is %d)\n\n"
+		"   -t seconds: minimal duration of one measurement, short stages are looped\n"
+		"        (default value is %.2f)\n\n"
+		"   -m max_size: the biggest size of FFT to measure (power of 2)\n"
+		"        (default value is 1048576)\n\n"
+		"   -s stage:   measure only stages with name starting with \"stage\",\n"
+		"               one of \"fft\", \"ifft\", \"kernel\", \"modifs\", \"window\", \"wav\"\n\n"
+		"   -o json_file: write results in JSON format to \"json_file\"\n"
+		"        (default value is bench.json)\n\n"
+		"   -W wisdom:  FFT wisdom file shared with befft, \"-\" turns measuring of kernels off\n"
+		"        (default value is %s)\n", program_name, DEFAULT_REPEATS, DEFAULT_MIN_TIME, DEFAULT_WISDOM);
+	exit (ERROR_EXIT_CODE);
+}
+
+/*
+ *  Returns current value of monotonic clock in seconds.
+ */
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+ *  Comparator of doubles for qsort.
+ */
+static int cmpDoubles(const void *a, const void *b) {
+	double da = *(const double *) a;
+	double db = *(const double *) b;
+	return (da > db) - (da < db);
+}
+
+/*
+ *  Measures given stage and prints out the result, also adds it to
+ *   the JSON file.
+ */
+static void measure(struct stage *st) {
+	double *times = allocDoubles(repeats);
+	long iters = 1;
+	int i;
+	long j;
+
+	/* Warm up, also finds number of calls needed for "min_time" */
+	double t0 = now();
+	st->run(st->arg);
+	double once = now() - t0;
+	if (once < min_time) {
+		iters = (long) ceil(min_time/MAX(once, 1e-9));
+	}
+
+	for (i=0; i<repeats; i++) {
+		t0 = now();
+		for (j=0; j<iters; j++) {
+			st->run(st->arg);
+		}
+		times[i] = (now() - t0)/iters;
+	}
+
+	double mean = 0.0, dev = 0.0;
+	for (i=0; i<repeats; i++) {
+		mean += times[i];
+	}
+	mean /= repeats;
+	for (i=0; i<repeats; i++) {
+		dev += (times[i] - mean)*(times[i] - mean);
+	}
+	dev = sqrt(dev/repeats);
+	qsort(times, repeats, sizeof(double), cmpDoubles);
+	double median = times[repeats/2];
+	double best = times[0];
+
+	double ns_sample = median*1e9/st->samples;
+	double gflops = (st->flops > 0) ? st->flops/median*1e-9 : 0.0;
+	printf("%-18s %8d %12.3f %12.3f %12.3f %8.2f%% %10.3f %12.0f %8.3f\n", st->name, st->param,
+		median*1e6, best*1e6, mean*1e6, 100.0*dev/mean, ns_sample, st->samples/median, gflops);
+	fflush(stdout);
+
+	fprintf(json, "%s\n    {\"stage\": \"%s\", \"param\": %d, \"samples\": %ld, \"repeats\": %d, \"iterations\": %ld, "
+		"\"median_ns\": %.1f, \"min_ns\": %.1f, \"mean_ns\": %.1f, \"stddev_ns\": %.1f, "
+		"\"ns_per_sample\": %.4f, \"samples_per_s\": %.1f, \"gflops\": ",
+		(json_count++ > 0) ? "," : "", st->name, st->param, st->samples, repeats, iters,
+		median*1e9, best*1e9, mean*1e9, dev*1e9, ns_sample, st->samples/median);
+	if (st->flops > 0) {
+		fprintf(json, "%.4f}", gflops);
+	} else {
+		fprintf(json, "null}");
+	}
+
+	free(times);
+}
+
+/*
+ *  Returns array of "len" samples with noise and few sinus tones.
+ */
+static C_ARRAY *synthetic(int len) {
+	C_ARRAY *ca = allocCA(len);
+	ca->len = len;
+	int i;
+	for (i=0; i<len; i++) {
+		double t = (double) i/BENCH_SRATE;
+		ca->c[i].re = 0.2*sin(2*M_PI*440*t) + 0.1*sin(2*M_PI*3000*t) + 0.05*(rand()/(double) RAND_MAX - 0.5);
+	}
+
+	return ca;
+}
+
+
+/*
+ *  MEASURED FUNCTIONS
+ */
+
+static void runFFT(void *arg) {
+	freeCA(fft((C_ARRAY *) arg));
+}
+
+static void runIFFT(void *arg) {
+	freeCA(ifft((C_ARRAY *) arg));
+}
+
+/*
+ *  Arguments for measurement of one FFT kernel.
+ */
+struct kernel_arg {
+	struct fft_plan *plan;
+	C_ARRAY *in;
+};
+
+static void runKernel(void *arg) {
+	struct kernel_arg *ka = (struct kernel_arg *) arg;
+	freeCA(runPlan(ka->plan, ka->in));
+}
+
+/*
+ *  Arguments for measurement of modifications.
+ */
+struct modif_arg {
+	struct b_modif *head;
+	struct octave *oct;
+	C_ARRAY *spec;
+	C_ARRAY *work;
+};
+
+static void runModifs(void *arg) {
+	struct modif_arg *ma = (struct modif_arg *) arg;
+	copyCA(ma->spec, 0, ma->work, 0, ma->spec->len);
+	ma->work->len = ma->spec->len;
+	processModifs(ma->head, ma->work, ma->oct, BENCH_SRATE);
+}
+
+/*
+ *  Arguments for measurement of window functions, every iteration
+ *   applies the window on fresh copy of "src".
+ */
+struct window_arg {
+	C_ARRAY *src;
+	C_ARRAY *work;
+};
+
+static C_ARRAY *freshWindow(struct window_arg *wa) {
+	copyCA(wa->src, 0, wa->work, 0, wa->src->len);
+	wa->work->len = wa->src->len;
+	return wa->work;
+}
+
+static void runHamming(void *arg) {
+	hammingWindow(freshWindow((struct window_arg *) arg), 0.53836, 0.46164);
+}
+
+static void runPlanck(void *arg) {
+	planckWindow(freshWindow((struct window_arg *) arg), 0.1);
+}
+
+static void runTukey(void *arg) {
+	tukeyWindow(freshWindow((struct window_arg *) arg), 0.1);
+}
+
+/*
+ *  Arguments for measurement of WAV input and output.
+ */
+struct wav_arg {
+	char *path;
+	ELEMENT *header;
+	C_ARRS *data;
+};
+
+static void runReadWav(void *arg) {
+	struct wav_arg *wa = (struct wav_arg *) arg;
+	C_ARRS *cas = allocCAS(2);
+	freeHeader(readWav(cas, wa->path));
+	freeCAS(cas);
+}
+
+static void runWriteWav(void *arg) {
+	struct wav_arg *wa = (struct wav_arg *) arg;
+	writeWav(wa->header, wa->data, wa->path);
+}
+
+
+/*
+ *  Returns 1 if stage with given name should be measured.
+ */
+static int selected(const char *filter, const char *name) {
+	return filter == NULL || strncmp(name, filter, strlen(filter)) == 0;
+}
+
+/*
+ *  Read options, then measure all selected stages one by one.
+ */
+int main(int argc, char **argv) {
+	program_name = basename(argv[0]);
+
+	int opt;
+	int max_size = 1 << 20;
+	char *filter = NULL;
+	char *json_file = "bench.json";
+	char *wisdom_file = DEFAULT_WISDOM;
+	struct stage st;
+
+	while ((opt = getopt(argc, argv, "n:t:m:s:o:W:h")) != -1) {
+		switch (opt) {
+			case 'n':
+				repeats = MAX(atoi(optarg), 1);
+				break;
+			case 't':
+				min_time = atof(optarg);
+				break;
+			case 'm':
+				max_size = atoi(optarg);
+				break;
+			case 's':
+				filter = optarg;
+				break;
+			case 'o':
+				json_file = optarg;
+				break;
+			case 'W':
+				wisdom_file = optarg;
+				break;
+			default:
+				usage();
+				break;
+		}
+	}
+
+	if ((json = fopen(json_file, "w")) == NULL) {
+		perror("fopen");
+		exit (ERROR_EXIT_CODE);
+	}
+	fprintf(json, "{\n  \"repeats\": %d,\n  \"min_time_s\": %.3f,\n  \"results\": [", repeats, min_time);
+	/* Modifications and WAV functions print their progress, keep them quiet */
+	debug = 100;
+
+	/* The same kernels as befft uses on this machine, missing file is not an error */
+	if (strcmp(wisdom_file, "-") == 0) {
+		plan_mode = PLAN_ESTIMATE;
+	} else {
+		loadWisdom(wisdom_file);
+	}
+
+	printf("%-18s %8s %12s %12s %12s %9s %10s %12s %8s\n", "stage", "param",
+		"median[us]", "min[us]", "mean[us]", "dev", "ns/sample", "samples/s", "GFLOPS");
+
+	/* Transforms, ~5*N*log2(N) operations */
+	int n;
+	for (n=64; n <= max_size; n *= 2) {
+		C_ARRAY *in = synthetic(n);
+		st.samples = n;
+		st.param = n;
+		st.flops = 5.0*n*log2(n);
+		st.arg = in;
+		/* Kernel is chosen before the measuring */
+		getPlan(n);
+		if (selected(filter, "fft")) {
+			st.name = "fft"; st.run = runFFT;
+			measure(&st);
+		}
+		if (selected(filter, "ifft")) {
+			C_ARRAY *spec = fft(in);
+			st.name = "ifft"; st.run = runIFFT; st.arg = spec;
+			measure(&st);
+			freeCA(spec);
+		}
+		/* Every kernel of the planner separately */
+		if (selected(filter, "kernel")) {
+			struct kernel_arg ka;
+			char name[32];
+			int k;
+			ka.in = in;
+			for (k=0; k<KERNELS; k++) {
+				ka.plan = makePlan(n, k);
+				sprintf(name, "kernel-%s", kernelName(k));
+				st.name = name; st.run = runKernel; st.arg = &ka;
+				measure(&st);
+				freePlan(ka.plan);
+			}
+		}
+		freeCA(in);
+	}
+
+	/* Modifications, every band of Octave is modified */
+	if (selected(filter, "modifs")) {
+		C_ARRAY *in = synthetic(MODIF_LEN);
+		struct modif_arg ma;
+		ma.spec = fft(in);
+		ma.work = allocCA(MODIF_LEN);
+		int frac;
+		for (frac=1; frac <= 24; frac++) {
+			ma.oct = initOctave(1000, frac);
+			ma.head = NULL;
+			int b;
+			for (b=1; b <= ma.oct->len; b++) {
+				struct b_modif *nbm = (struct b_modif *) malloc(sizeof(struct b_modif));
+				if (nbm == NULL) {
+					perror("malloc");
+					exit (ERROR_EXIT_CODE);
+				}
+				nbm->band_id = b;
+				nbm->gain = (b % 2) ? 6.0 : -6.0;
+				nbm->modif_f = (b % 3 == 0) ? flatBand : (b % 3 == 1) ? peakBand : nextBand;
+				nbm->next = ma.head;
+				ma.head = nbm;
+			}
+			st.name = "modifs"; st.param = frac;
+			st.samples = MODIF_LEN; st.flops = 0;
+			st.run = runModifs; st.arg = &ma;
+			measure(&st);
+			freeModifs(ma.head);
+			freeOctave(ma.oct);
+		}
+		freeCA(ma.spec); freeCA(ma.work); freeCA(in);
+	}
+
+	/* Window functions */
+	if (selected(filter, "window")) {
+		struct window_arg wa;
+		wa.src = synthetic(MODIF_LEN);
+		wa.work = allocCA(MODIF_LEN);
+		st.param = MODIF_LEN; st.samples = MODIF_LEN; st.flops = 0; st.arg = &wa;
+		st.name = "window-hamming"; st.run = runHamming;
+		measure(&st);
+		st.name = "window-planck"; st.run = runPlanck;
+		measure(&st);
+		st.name = "window-tukey"; st.run = runTukey;
+		measure(&st);
+		freeCA(wa.src); freeCA(wa.work);
+	}
+
+	/* Reading and writing of stereo WAV file */
+	if (selected(filter, "wav")) {
+		struct wav_arg wa;
+		char path[] = "/tmp/befft_bench_XXXXXX";
+		int fd = mkstemp(path);
+		if (fd < 0) {
+			perror("mkstemp");
+			exit (ERROR_EXIT_CODE);
+		}
+		close(fd);
+		int len = WAV_SECONDS*BENCH_SRATE;
+		wa.path = path;
+		wa.data = allocCAS(2);
+		wa.data->carrs[wa.data->len++] = synthetic(len);
+		wa.data->carrs[wa.data->len++] = synthetic(len);
+		wa.header = createHeader(2, BENCH_SRATE, 16, len);
+
+		st.param = len; st.samples = 2L*len; st.flops = 0; st.arg = &wa;
+		st.name = "wav-write"; st.run = runWriteWav;
+		measure(&st);
+		freeHeader(wa.header);
+		st.name = "wav-read"; st.run = runReadWav;
+		measure(&st);
+
+		freeCAS(wa.data);
+		unlink(path);
+	}
+
+	fprintf(json, "\n  ]\n}\n");
+	if (fclose(json) == EOF) {
+		perror("fclose");
+		exit (ERROR_EXIT_CODE);
+	}
+	printf("Results written to \"%s\"\n", json_file);
+
+	/* Kernels measured here are used by befft too */
+	if (newWisdom() && saveWisdom(wisdom_file) == 0) {
+		printf("FFT wisdom written to \"%s\"\n", wisdom_file);
+	}
+
+	return (0);
+}
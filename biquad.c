@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  biquad.c
+ *
+ *    Description:  Time domain engine. Every virtual knob is mapped to one
+ *                  peaking or shelving biquad filter and all of them are
+ *                  applied sample by sample as a cascade, so there is no
+ *                  latency. All channels are filtered together, one channel
+ *                  in every lane of vector registers.
+ *
+ *                  Coefficients are counted by formulas from Audio EQ
+ *                  Cookbook by Robert Bristow-Johnson.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "biquad.h"
+#include "knobs.h"
+#include "equalizer.h"
+#include "complex.h"
+#include "my_std.h"
+
+/* Number of channels filtered together in one vector */
+#define LANES 4
+
+/* Vector of doubles, one lane for every channel */
+typedef double v4d __attribute__ ((vector_size (LANES*sizeof(double))));
+
+/*
+ *  Coefficients of one biquad section copied into every lane.
+ */
+struct bq_lanes {
+	v4d b0, b1, b2;
+	v4d a1, a2;
+};
+
+/*
+ *  Types of biquad sections used by this engine.
+ */
+enum bq_type {
+	BQ_PEAK,      /* Peaking filter around the center frequency */
+	BQ_LOWSHELF,  /* Gain is applied bellow the corner frequency */
+	BQ_HIGHSHELF  /* Gain is applied above the corner frequency */
+};
+
+
+/*
+ *  Counts coefficients of biquad section of given type with frequency "f0"
+ *   (in Hz), bandwidth "bw" (in octaves) and gain "gain" (in dB).
+ */
+static struct biquad makeBiquad(enum bq_type type, double f0, double bw, double gain, int srate) {
+	struct biquad bq;
+	double A = pow(10.0, gain/40.0);
+	double w0 = 2.0*M_PI*f0/srate;
+	double cw = cos(w0);
+	double sw = sin(w0);
+	double alpha = sw*sinh(log(2.0)/2.0 * bw * w0/sw);
+	double a0;
+
+	switch (type) {
+		case BQ_LOWSHELF:
+			alpha = sw/2.0 * sqrt(2.0);
+			a0    =          (A+1) + (A-1)*cw + 2*sqrt(A)*alpha;
+			bq.b0 =     A*( (A+1) - (A-1)*cw + 2*sqrt(A)*alpha);
+			bq.b1 =   2*A*( (A-1) - (A+1)*cw);
+			bq.b2 =     A*( (A+1) - (A-1)*cw - 2*sqrt(A)*alpha);
+			bq.a1 =    -2*( (A-1) + (A+1)*cw);
+			bq.a2 =          (A+1) + (A-1)*cw - 2*sqrt(A)*alpha;
+			break;
+		case BQ_HIGHSHELF:
+			alpha = sw/2.0 * sqrt(2.0);
+			a0    =          (A+1) - (A-1)*cw + 2*sqrt(A)*alpha;
+			bq.b0 =     A*( (A+1) + (A-1)*cw + 2*sqrt(A)*alpha);
+			bq.b1 =  -2*A*( (A-1) + (A+1)*cw);
+			bq.b2 =     A*( (A+1) + (A-1)*cw - 2*sqrt(A)*alpha);
+			bq.a1 =     2*( (A-1) - (A+1)*cw);
+			bq.a2 =          (A+1) - (A-1)*cw - 2*sqrt(A)*alpha;
+			break;
+		default:
+			a0    = 1 + alpha/A;
+			bq.b0 = 1 + alpha*A;
+			bq.b1 = -2*cw;
+			bq.b2 = 1 - alpha*A;
+			bq.a1 = -2*cw;
+			bq.a2 = 1 - alpha/A;
+			break;
+	}
+
+	bq.b0 /= a0; bq.b1 /= a0; bq.b2 /= a0;
+	bq.a1 /= a0; bq.a2 /= a0;
+
+	return bq;
+}
+
+/*
+ *  Maps every modification from the list to one biquad section:
+ *   flat  - peaking filter covering the whole band, the first and
+ *           the last band of Octave are covered by shelving filters,
+ *   peak  - peaking filter with half of the bandwidth of the band,
+ *   next  - peaking filter around the center of the next band.
+ *  Returns array of sections and stores its length in "count".
+ */
+struct biquad *designBiquads(struct b_modif *head, struct octave *oct, int srate, int *count) {
+	struct biquad *bqs;
+	struct b_modif *actb;
+	int len = 0;
+
+	for (actb=head; actb != NULL; actb=actb->next) {
+		len++;
+	}
+	if ((bqs = (struct biquad *) malloc(MAX(len, 1) * sizeof(struct biquad))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+
+	*count = 0;
+	for (actb=head; actb != NULL; actb=actb->next) {
+		struct band *b = getBand(oct, actb->band_id);
+		/* Width of the band in octaves */
+		double bw = log2(b->upperE/b->lowerE);
+		enum bq_type type = BQ_PEAK;
+		double f0 = b->center;
+
+		if (actb->modif_f == flatBand && actb->band_id == 1) {
+			type = BQ_LOWSHELF;
+			f0 = b->upperE;
+		} else if (actb->modif_f == flatBand && actb->band_id == oct->len) {
+			type = BQ_HIGHSHELF;
+			f0 = b->lowerE;
+		} else if (actb->modif_f == peakBand) {
+			bw /= 2.0;
+		} else if (actb->modif_f == nextBand) {
+			f0 = b->center*(b->upperE/b->lowerE);
+		}
+
+		/* Filters above the Nyquist frequency are not stable */
+		if (f0 >= srate/2.0) {
+			log_out(45, "Skipping biquad at %.2fHz, sample rate is only %dHz\n", f0, srate);
+			continue;
+		}
+		log_out(45, "Biquad %d at %.2fHz, bandwidth %.2f octaves, gain %.2fdB\n", type, f0, bw, actb->gain);
+		bqs[(*count)++] = makeBiquad(type, f0, bw, actb->gain, srate);
+	}
+
+	return bqs;
+}
+
+/*
+ *  Filters up to LANES channels from "ins" starting at channel "first"
+ *   by the cascade, results are stored in the same channels of "outs".
+ *   Transposed direct form II is used for every section.
+ */
+static void cascadeLanes(C_ARRS *ins, C_ARRS *outs, int first, struct biquad *bq, int count) {
+	int nch = MIN(LANES, ins->len - first);
+	struct bq_lanes *cf;
+	v4d *z1, *z2;
+	int len = 0;
+	int ch, s, i;
+
+	if ((z1 = (v4d *) calloc(MAX(count, 1), sizeof(v4d))) == NULL ||
+	    (z2 = (v4d *) calloc(MAX(count, 1), sizeof(v4d))) == NULL ||
+	    (cf = (struct bq_lanes *) calloc(MAX(count, 1), sizeof(struct bq_lanes))) == NULL) {
+		perror("calloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	/* Broadcast coefficients of every section to all lanes */
+	for (s=0; s<count; s++) {
+		cf[s].b0 += bq[s].b0; cf[s].b1 += bq[s].b1; cf[s].b2 += bq[s].b2;
+		cf[s].a1 += bq[s].a1; cf[s].a2 += bq[s].a2;
+	}
+	for (ch=0; ch<nch; ch++) {
+		len = MAX(len, ins->carrs[first + ch]->len);
+	}
+
+	for (i=0; i<len; i++) {
+		v4d x = {0, 0, 0, 0};
+		for (ch=0; ch<nch; ch++) {
+			if (i < ins->carrs[first + ch]->len) {
+				x[ch] = ins->carrs[first + ch]->c[i].re;
+			}
+		}
+
+		for (s=0; s<count; s++) {
+			v4d y = cf[s].b0*x + z1[s];
+			z1[s] = cf[s].b1*x - cf[s].a1*y + z2[s];
+			z2[s] = cf[s].b2*x - cf[s].a2*y;
+			x = y;
+		}
+
+		for (ch=0; ch<nch; ch++) {
+			if (i < outs->carrs[first + ch]->max) {
+				outs->carrs[first + ch]->c[i].re = x[ch];
+			}
+		}
+	}
+	for (ch=0; ch<nch; ch++) {
+		outs->carrs[first + ch]->len = ins->carrs[first + ch]->len;
+	}
+
+	free(z1); free(z2); free(cf);
+}
+
+/*
+ *  Applies cascade of "count" biquad sections on all channels from
+ *   "ins" and stores results in "outs", which has to be allocated.
+ */
+void biquadCascade(C_ARRS *ins, C_ARRS *outs, struct biquad *bq, int count) {
+	int first;
+	log_out(45, "Biquad cascade with %d sections on %d channels\n", count, ins->len);
+	for (first=0; first < ins->len; first += LANES) {
+		cascadeLanes(ins, outs, first, bq, count);
+	}
+}
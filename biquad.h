@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  biquad.h
+ *
+ *    Description:  Time domain engine. Every virtual knob is mapped to one
+ *                  peaking or shelving biquad filter and all of them are
+ *                  applied sample by sample as a cascade, so there is no
+ *                  latency. All channels are filtered together, one channel
+ *                  in every lane of vector registers.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef BIQUAD_H_
+#define BIQUAD_H_
+
+#include "complex.h"
+#include "equalizer.h"
+#include "knobs.h"
+
+
+/*
+ *  Coefficients of one biquad section, normalized so that a0 == 1.
+ */
+struct biquad {
+	double b0, b1, b2;
+	double a1, a2;
+};
+
+
+extern struct biquad *designBiquads(struct b_modif *head, struct octave *oct, int srate, int *count);
+extern void biquadCascade(C_ARRS *ins, C_ARRS *outs, struct biquad *bq, int count);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  codelets.h
+ *
+ *    Description:  FFT codelets, straight-line transforms of sizes from 1
+ *                  to 64. Codelets are generated by gencodelets into file
+ *                  codelets.c during the build, codelet of size 2^k is
+ *                  stored in table codelets on index k.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef CODELETS_H_
+#define CODELETS_H_
+
+#include "complex.h"
+
+/* Number of codelets, the biggest one is of size 2^(CODELETS-1) */
+#define CODELETS 7
+/* Size of the biggest codelet */
+#define CODELET_MAX (1 << (CODELETS - 1))
+
+/*
+ *  Codelet computes transform of elements in[0], in[is], in[2*is], ...
+ *   and stores the unscaled result into out[0], out[1], ...
+ */
+typedef void (*codelet_f)(const COMPLEX *in, int is, COMPLEX *out);
+
+
+extern codelet_f codelets[CODELETS];
+
+#endif
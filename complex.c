@@ -93,7 +93,6 @@ COMPLEX polarToComplex(double r, double fi) {
  */
 COMPLEX gainToComplex(COMPLEX cin, double gain) {
 	COMPLEX cret;
-	double aktdec = decibel(cin);
 	double MC = 1.0;
 	if (cin.im != 0 || cin.re == 0) {
 		MC = sqrt(pow(10.0, gain*0.1));
@@ -101,7 +100,7 @@ COMPLEX gainToComplex(COMPLEX cin, double gain) {
 	cret.re = cin.re * MC;
 	cret.im = cin.im * MC;
 
-	log_out(11, "before=%.2fdB after=%.2fdB, dif = %.2f\n", aktdec, decibel(cret), decibel(cret)-aktdec);
+	log_out(11, "before=%.2fdB after=%.2fdB, dif = %.2f\n", decibel(cin), decibel(cret), decibel(cret)-decibel(cin));
 	return cret;
 }
 
@@ -0,0 +1,712 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  daemon.c
+ *
+ *    Description:  Spool directory daemon. WAV files which appear in the
+ *                  incoming directory are found by inotify and processed
+ *                  as jobs by persistent pool of worker threads, so FFT
+ *                  plans, octave bands and compiled response curves are
+ *                  made only once for all of them. Knobs of every job are
+ *                  in optional sidecar file, finished outputs are moved
+ *                  into the done directory atomically and state of the
+ *                  daemon is kept in the status file.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "daemon.h"
+#include "knobs.h"
+#include "equalizer.h"
+#include "complex.h"
+#include "wave.h"
+#include "fft.h"
+#include "prof.h"
+#include "my_std.h"
+
+/* How often the status file is rewritten, when nothing happens (in ms) */
+#define DAEMON_STATUS 1000
+/* Upper limit for the number of cached response curves */
+#define DAEMON_CURVES 64
+/* Maximal length of knobs in the sidecar file */
+#define DAEMON_MAX_KNOBS 4096
+/* Maximal length of path inside the spool */
+#define DAEMON_PATH 4096
+
+/* Subdirectories of the spool */
+#define DIR_INCOMING "incoming"
+#define DIR_WORK "work"
+#define DIR_DONE "done"
+#define DIR_FAILED "failed"
+
+/* Job is WAV file "name.wav", its knobs are in "name.knobs" */
+#define EXT_WAV ".wav"
+#define EXT_KNOBS ".knobs"
+
+
+/*
+ *  Job waiting in the queue, "name" is without the extension.
+ */
+struct job {
+	char *name;
+	struct job *next;
+};
+
+/*
+ *  Compiled response curve of knobs "knobs" for spectrum of input
+ *   in sample rate "srate".
+ */
+struct curve {
+	char *knobs;
+	int srate;
+	double *gains;
+	double max_gain;
+	double broadband;       /* Gain of silent windows */
+	int identity;           /* Knobs do not modify anything */
+	struct curve *next;
+};
+
+/*
+ *  State of the daemon shared by all workers.
+ */
+struct daemon {
+	char *spool;
+	struct octave *oct;
+	int wlen;
+	int workers;
+	char *knobs;            /* Knobs of jobs without sidecar file */
+	double s_value;         /* Silence level in dBFS */
+	pthread_mutex_t lock;   /* Guards all members bellow */
+	pthread_cond_t cond;    /* Signals new job or stopping */
+	struct job *first, *last;
+	int queued;
+	int running;
+	int stopping;
+	long done, failed;
+	unsigned long long samples;  /* Processed samples of all channels */
+	double audio;           /* Processed sound in seconds */
+	unsigned long long t0;  /* Start of the daemon */
+	struct curve *curves;
+	int ncurves;
+	long hits, misses;      /* Lookups of curves in the cache */
+};
+
+/* Set by signal handler, the daemon stops after running jobs are done */
+static volatile sig_atomic_t daemon_stop = 0;
+
+
+/*
+ *  Stores path of file "name" with extension "ext" in spool subdirectory
+ *   "dir" into "path" (of DAEMON_PATH bytes). Returns 0 on success, -1
+ *   if the path is too long.
+ */
+static int spoolPath(struct daemon *d, char *path, char *dir, char *name, char *ext) {
+	if (snprintf(path, DAEMON_PATH, "%s/%s/%s%s", d->spool, dir, name, ext) >= DAEMON_PATH) {
+		fprintf(stderr, "Path of job \"%s\" is too long\n", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ *  Returns 1 if "fname" is name of the job, i.e. visible WAV file.
+ */
+static int isJob(char *fname) {
+	int len = strlen(fname), elen = strlen(EXT_WAV);
+	return fname[0] != '.' && len > elen && strcmp(fname + len - elen, EXT_WAV) == 0;
+}
+
+/*
+ *  Appends job from WAV file "fname" to the queue, if it is not there
+ *   already. The same file can be found by the first scan and by inotify.
+ */
+static void enqueue(struct daemon *d, char *fname) {
+	int len = strlen(fname) - strlen(EXT_WAV);
+	struct job *j;
+
+	pthread_mutex_lock(&d->lock);
+	for (j=d->first; j != NULL; j=j->next) {
+		if (strncmp(j->name, fname, len) == 0 && j->name[len] == '\0') {
+			pthread_mutex_unlock(&d->lock);
+			return;
+		}
+	}
+	if ((j = (struct job *) malloc(sizeof(struct job))) == NULL ||
+	    (j->name = strndup(fname, len)) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	j->next = NULL;
+	if (d->last != NULL) {
+		d->last->next = j;
+	} else {
+		d->first = j;
+	}
+	d->last = j;
+	d->queued++;
+	pthread_cond_signal(&d->cond);
+	pthread_mutex_unlock(&d->lock);
+}
+
+/*
+ *  Rewrites the status file, new content is written into temporary file
+ *   first, so that readers never see it half written.
+ */
+static void writeStatus(struct daemon *d, char *state) {
+	char path[DAEMON_PATH], tmp[DAEMON_PATH];
+	snprintf(path, DAEMON_PATH, "%s/status", d->spool);
+	snprintf(tmp, DAEMON_PATH, "%s/.status.tmp", d->spool);
+
+	FILE *fout;
+	if ((fout = fopen(tmp, "w")) == NULL) {
+		perror("fopen");
+		return;
+	}
+	pthread_mutex_lock(&d->lock);
+	double uptime = (profNow() - d->t0)*1e-9;
+	fprintf(fout, "state %s\n", state);
+	fprintf(fout, "workers %d\n", d->workers);
+	fprintf(fout, "queued %d\n", d->queued);
+	fprintf(fout, "running %d\n", d->running);
+	fprintf(fout, "done %ld\n", d->done);
+	fprintf(fout, "failed %ld\n", d->failed);
+	fprintf(fout, "uptime %.1f\n", uptime);
+	fprintf(fout, "audio %.1f\n", d->audio);
+	/* Throughput is counted for the whole time the daemon runs */
+	fprintf(fout, "samples_per_sec %.0f\n", d->samples/uptime);
+	fprintf(fout, "realtime %.2f\n", d->audio/uptime);
+	fprintf(fout, "curves %d\n", d->ncurves);
+	fprintf(fout, "curve_hits %ld\n", d->hits);
+	fprintf(fout, "curve_misses %ld\n", d->misses);
+	pthread_mutex_unlock(&d->lock);
+	fclose(fout);
+
+	if (rename(tmp, path) != 0) {
+		perror("rename");
+	}
+}
+
+/*
+ *  Compiles response curve of "knobs" for sample rate "srate". Returns
+ *   NULL if the knobs are not valid.
+ */
+static struct curve *compileCurve(struct daemon *d, char *knobs, int srate) {
+	struct b_modif *modifs = NULL;
+	if (initModifs(&modifs, d->oct, knobs) != 0) {
+		freeModifs(modifs);
+		return NULL;
+	}
+
+	struct curve *c;
+	if ((c = (struct curve *) malloc(sizeof(struct curve))) == NULL ||
+	    (c->knobs = strdup(knobs)) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	c->srate = srate;
+	c->gains = compileGains(modifs, d->oct, d->wlen, srate);
+	c->max_gain = maxGain(c->gains, d->wlen);
+	c->broadband = broadbandGain(c->gains, d->wlen);
+	c->identity = isIdentity(c->gains, d->wlen);
+	c->next = NULL;
+	freeModifs(modifs);
+
+	return c;
+}
+
+/*
+ *  Releases one curve.
+ */
+static void freeCurve(struct curve *c) {
+	free(c->knobs);
+	free(c->gains);
+	free(c);
+}
+
+/*
+ *  Returns cached curve of "knobs" for sample rate "srate", the curve is
+ *   compiled and added to the cache if it is not there. When the cache
+ *   is full, "owned" is set to 1 and the caller has to free the curve.
+ *   Returns NULL if the knobs are not valid.
+ */
+static struct curve *getCurve(struct daemon *d, char *knobs, int srate, int *owned) {
+	struct curve *c;
+	*owned = 0;
+
+	pthread_mutex_lock(&d->lock);
+	for (c=d->curves; c != NULL; c=c->next) {
+		if (c->srate == srate && strcmp(c->knobs, knobs) == 0) {
+			d->hits++;
+			pthread_mutex_unlock(&d->lock);
+			return c;
+		}
+	}
+	d->misses++;
+	pthread_mutex_unlock(&d->lock);
+
+	/* Other jobs do not wait for compilation */
+	struct curve *nc;
+	if ((nc = compileCurve(d, knobs, srate)) == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&d->lock);
+	for (c=d->curves; c != NULL; c=c->next) {
+		/* Another worker compiled the same curve meanwhile */
+		if (c->srate == srate && strcmp(c->knobs, knobs) == 0) {
+			pthread_mutex_unlock(&d->lock);
+			freeCurve(nc);
+			return c;
+		}
+	}
+	if (d->ncurves < DAEMON_CURVES) {
+		nc->next = d->curves;
+		d->curves = nc;
+		d->ncurves++;
+	} else {
+		*owned = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	return nc;
+}
+
+/*
+ *  Modifies tracks "in1" and "in2" (can be NULL) of the same length by
+ *   response curve "gains" window by window, like fftEnginePair does.
+ *   Windows with RMS bellow "level" are only multiplied by "sgain".
+ *   Results are stored in "out1" and "out2", "win" is buffer for "wlen"
+ *   samples.
+ */
+static void processPair(C_ARRAY *in1, C_ARRAY *in2, C_ARRAY *out1, C_ARRAY *out2, double *gains, int wlen, double level, double sgain, C_ARRAY *win) {
+	C_ARRAY *re1, *re2, *ire;
+	int ilen = in1->len;
+	int wst, j;
+
+	for (wst=0; wst < ilen; wst += wlen) {
+		int cnt = MIN(wlen, ilen - wst);
+		int silent1 = belowLevel(in1, wst, cnt, level);
+		int silent2 = (in2 == NULL) || belowLevel(in2, wst, cnt, level);
+		if (silent1) {
+			copySilent(in1, wst, out1, wst, cnt, sgain);
+		}
+		if (in2 != NULL && silent2) {
+			copySilent(in2, wst, out2, wst, cnt, sgain);
+		}
+		if (silent1 && silent2) {
+			continue;
+		}
+
+		initCA(win, wlen, 0);
+		if (!silent1 && !silent2) {
+			/* Both tracks are transformed together */
+			for (j=0; j<cnt; j++) {
+				setCA(win, j, in1->c[wst + j].re, in2->c[wst + j].re);
+			}
+			win->len = wlen;
+			fftPair(win, &re1, &re2);
+			applyGains(gains, re1);
+			applyGains(gains, re2);
+			ire = ifftPair(re1, re2);
+			for (j=0; j<cnt; j++) {
+				setCA(out1, wst + j, ire->c[j].re, 0.0);
+				setCA(out2, wst + j, ire->c[j].im, 0.0);
+			}
+			freeCA(re1); freeCA(re2);
+		} else {
+			C_ARRAY *in = (silent1) ? in2 : in1;
+			C_ARRAY *out = (silent1) ? out2 : out1;
+			copyCA(in, wst, win, 0, cnt);
+			win->len = wlen;
+			re1 = fft(win);
+			applyGains(gains, re1);
+			ire = ifft(re1);
+			copyCA(ire, 0, out, wst, cnt);
+			freeCA(re1);
+		}
+		freeCA(ire);
+	}
+	out1->len = ilen;
+	if (out2 != NULL) {
+		out2->len = ilen;
+	}
+}
+
+/*
+ *  Moves file "name" with extension "ext" from spool subdirectory "from"
+ *   into "to". Returns result of rename.
+ */
+static int moveFile(struct daemon *d, char *name, char *ext, char *from, char *to) {
+	char src[DAEMON_PATH], dst[DAEMON_PATH];
+	if (spoolPath(d, src, from, name, ext) != 0 || spoolPath(d, dst, to, name, ext) != 0) {
+		return -1;
+	}
+
+	return rename(src, dst);
+}
+
+/*
+ *  Processes job "name". The job is claimed by moving it into the work
+ *   directory, output is written into hidden temporary file in the done
+ *   directory and renamed when it is complete, input is then removed
+ *   and the sidecar is moved next to the output. Failed jobs are moved
+ *   into the failed directory. Length of the processed sound is stored
+ *   in "secs" and "samples". Returns 0 on success, -1 if the job failed
+ *   and 1 if the job was claimed by someone else.
+ */
+static int runJob(struct daemon *d, char *name, double *secs, unsigned long long *samples) {
+	char path[DAEMON_PATH], tmp[DAEMON_PATH], out[DAEMON_PATH];
+	if (spoolPath(d, path, DIR_WORK, name, EXT_WAV) != 0 ||
+	    spoolPath(d, tmp, DIR_DONE, ".", name) != 0 ||
+	    spoolPath(d, out, DIR_DONE, name, EXT_WAV) != 0) {
+		return -1;
+	}
+	if (moveFile(d, name, EXT_WAV, DIR_INCOMING, DIR_WORK) != 0) {
+		return 1;
+	}
+
+	/* Knobs of the sidecar file are taken together with the job */
+	char knobs[DAEMON_MAX_KNOBS], kpath[DAEMON_PATH];
+	int sidecar = 0;
+	strcpy(knobs, (d->knobs != NULL) ? d->knobs : "");
+	if (moveFile(d, name, EXT_KNOBS, DIR_INCOMING, DIR_WORK) == 0) {
+		sidecar = 1;
+		if (spoolPath(d, kpath, DIR_WORK, name, EXT_KNOBS) != 0 || readKnobs(kpath, knobs, sizeof(knobs)) != 0) {
+			goto failed;
+		}
+	}
+
+	C_ARRS *ins = allocCAS(2);
+	ELEMENT *header = readWav(ins, path);
+	if (header == NULL) {
+		freeCAS(ins);
+		goto failed;
+	}
+	int srate = getSampleRate(header);
+	int owned;
+	struct curve *c = getCurve(d, knobs, srate, &owned);
+	if (c == NULL) {
+		fprintf(stderr, "Invalid knobs \"%s\" of job \"%s\"\n", knobs, name);
+		freeHeader(header);
+		freeCAS(ins);
+		goto failed;
+	}
+
+	double level = silenceLevel(d->s_value, c->max_gain);
+	C_ARRS *outs = allocCAS(ins->len);
+	C_ARRAY *win = allocCA(d->wlen);
+	int ch;
+	for (ch=0; ch < ins->len; ch++) {
+		outs->carrs[outs->len++] = allocCA(ins->carrs[ch]->len);
+	}
+	for (ch=0; ch < ins->len; ch+=2) {
+		C_ARRAY *in2 = (ch + 1 < ins->len) ? ins->carrs[ch+1] : NULL;
+		C_ARRAY *out2 = (in2 != NULL) ? outs->carrs[ch+1] : NULL;
+		if (c->identity) {
+			copyCA(ins->carrs[ch], 0, outs->carrs[ch], 0, ins->carrs[ch]->len);
+			outs->carrs[ch]->len = ins->carrs[ch]->len;
+			if (in2 != NULL) {
+				copyCA(in2, 0, out2, 0, in2->len);
+				out2->len = in2->len;
+			}
+		} else {
+			processPair(ins->carrs[ch], in2, outs->carrs[ch], out2, c->gains, d->wlen, level, c->broadband, win);
+		}
+	}
+	*secs = (ins->len > 0) ? (double) ins->carrs[0]->len/srate : 0.0;
+	*samples = (ins->len > 0) ? (unsigned long long) ins->carrs[0]->len*ins->len : 0;
+	if (owned) {
+		freeCurve(c);
+	}
+
+	/* Output is complete only if the whole data block was written */
+	struct stat st;
+	unsigned long dsize = getSubchunk2Size(header);
+	writeWav(header, outs, tmp);
+	int written = (stat(tmp, &st) == 0 && st.st_size >= 44 + dsize);
+	freeHeader(header);
+	freeCA(win);
+	freeCAS(ins);
+	freeCAS(outs);
+	if (!written || rename(tmp, out) != 0) {
+		fprintf(stderr, "Output of job \"%s\" cannot be written\n", name);
+		unlink(tmp);
+		goto failed;
+	}
+	unlink(path);
+	if (sidecar) {
+		moveFile(d, name, EXT_KNOBS, DIR_WORK, DIR_DONE);
+	}
+
+	return 0;
+
+failed:
+	moveFile(d, name, EXT_WAV, DIR_WORK, DIR_FAILED);
+	if (sidecar) {
+		moveFile(d, name, EXT_KNOBS, DIR_WORK, DIR_FAILED);
+	}
+	return -1;
+}
+
+/*
+ *  Body of the worker thread, takes jobs from the queue until the daemon
+ *   stops. Jobs which are still queued stay in the incoming directory.
+ */
+static void *worker(void *arg) {
+	struct daemon *d = (struct daemon *) arg;
+
+	for (;;) {
+		pthread_mutex_lock(&d->lock);
+		while (!d->stopping && d->first == NULL) {
+			pthread_cond_wait(&d->cond, &d->lock);
+		}
+		if (d->stopping) {
+			pthread_mutex_unlock(&d->lock);
+			break;
+		}
+		struct job *j = d->first;
+		d->first = j->next;
+		if (d->first == NULL) {
+			d->last = NULL;
+		}
+		d->queued--;
+		d->running++;
+		pthread_mutex_unlock(&d->lock);
+
+		double secs = 0.0;
+		unsigned long long samples = 0, t0 = profNow();
+		int ret = runJob(d, j->name, &secs, &samples);
+		double ms = (profNow() - t0)*1e-6;
+
+		pthread_mutex_lock(&d->lock);
+		d->running--;
+		if (ret == 0) {
+			d->done++;
+			d->audio += secs;
+			d->samples += samples;
+		} else if (ret < 0) {
+			d->failed++;
+		}
+		pthread_mutex_unlock(&d->lock);
+
+		if (ret == 0) {
+			printf("Job \"%s\" done, %.1fs of sound in %.1fms\n", j->name, secs, ms);
+		} else if (ret < 0) {
+			printf("Job \"%s\" failed\n", j->name);
+		}
+		fflush(stdout);
+		if (ret <= 0) {
+			writeStatus(d, "running");
+		}
+		free(j->name);
+		free(j);
+	}
+
+	return NULL;
+}
+
+/*
+ *  Creates spool subdirectory "dir", existing one is fine. Returns 0 on
+ *   success, -1 otherwise.
+ */
+static int makeDir(struct daemon *d, char *dir) {
+	char path[DAEMON_PATH];
+	snprintf(path, DAEMON_PATH, "%s/%s", d->spool, dir);
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		perror("mkdir");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ *  Moves all files from spool subdirectory "from" into "to", if "jobs"
+ *   is set, only jobs are moved and their names are added to the queue.
+ */
+static void scanDir(struct daemon *d, char *from, char *to, int jobs) {
+	char path[DAEMON_PATH];
+	snprintf(path, DAEMON_PATH, "%s/%s", d->spool, from);
+
+	DIR *dir;
+	if ((dir = opendir(path)) == NULL) {
+		perror("opendir");
+		return;
+	}
+	struct dirent *de;
+	while ((de = readdir(dir)) != NULL) {
+		if (jobs && isJob(de->d_name)) {
+			enqueue(d, de->d_name);
+		} else if (!jobs && de->d_name[0] != '.') {
+			moveFile(d, de->d_name, "", from, to);
+		}
+	}
+	closedir(dir);
+}
+
+/*
+ *  Handler of SIGINT and SIGTERM.
+ */
+static void onSignal(int sig) {
+	daemon_stop = 1;
+}
+
+/*
+ *  Runs the daemon on spool directory "spool" with "workers" threads,
+ *   every job is modified by its knobs in windows of "wlen" samples,
+ *   "knobs" are used for jobs without sidecar file (can be NULL). Runs
+ *   until SIGINT or SIGTERM, then waits for the running jobs. Returns 0
+ *   on success, -1 if the spool cannot be watched.
+ */
+int runDaemon(char *spool, struct octave *oct, int wlen, int workers, char *knobs, double s_value) {
+	struct daemon d;
+	memset(&d, 0, sizeof(d));
+	d.spool = spool;
+	d.oct = oct;
+	d.wlen = wlen;
+	d.workers = workers;
+	d.knobs = knobs;
+	d.s_value = s_value;
+	d.t0 = profNow();
+	pthread_mutex_init(&d.lock, NULL);
+	pthread_cond_init(&d.cond, NULL);
+
+	if (makeDir(&d, "") != 0 || makeDir(&d, DIR_INCOMING) != 0 || makeDir(&d, DIR_WORK) != 0 ||
+	    makeDir(&d, DIR_DONE) != 0 || makeDir(&d, DIR_FAILED) != 0) {
+		return -1;
+	}
+	if (knobs != NULL && strlen(knobs) >= DAEMON_MAX_KNOBS) {
+		fprintf(stderr, "Default knobs are too long\n");
+		return -1;
+	}
+
+	/* Jobs interrupted by previous daemon are done again */
+	scanDir(&d, DIR_WORK, DIR_INCOMING, 0);
+
+	int fd;
+	char path[DAEMON_PATH];
+	snprintf(path, DAEMON_PATH, "%s/%s", spool, DIR_INCOMING);
+	if ((fd = inotify_init()) < 0) {
+		perror("inotify_init");
+		return -1;
+	}
+	/* Job is complete when its writer closes it, or when it is moved in */
+	if (inotify_add_watch(fd, path, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		perror("inotify_add_watch");
+		close(fd);
+		return -1;
+	}
+
+	/* Poll has to be interrupted by the signal, not restarted */
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	/* Plan of the window length is made before the first job comes */
+	getPlan(wlen);
+
+	pthread_t *threads;
+	if ((threads = (pthread_t *) malloc(workers * sizeof(pthread_t))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	int t;
+	for (t=0; t<workers; t++) {
+		if (pthread_create(&threads[t], NULL, worker, &d) != 0) {
+			perror("pthread_create");
+			exit (ERROR_EXIT_CODE);
+		}
+	}
+	printf("Watching \"%s\" with %d workers\n", path, workers);
+	fflush(stdout);
+
+	/* Files written before the watch was added are found by scanning */
+	scanDir(&d, DIR_INCOMING, NULL, 1);
+	writeStatus(&d, "running");
+
+	/* Buffer is aligned for the events */
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfd = {fd, POLLIN, 0};
+	while (!daemon_stop) {
+		int ret = poll(&pfd, 1, DAEMON_STATUS);
+		if (ret < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+		if (ret > 0) {
+			ssize_t len = read(fd, buf, sizeof(buf));
+			char *p;
+			for (p=buf; len > 0 && p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+				struct inotify_event *ev = (struct inotify_event *) p;
+				if (ev->len > 0 && isJob(ev->name)) {
+					enqueue(&d, ev->name);
+				}
+			}
+		}
+		writeStatus(&d, "running");
+	}
+
+	pthread_mutex_lock(&d.lock);
+	d.stopping = 1;
+	printf("Stopping, %d queued jobs stay in \"%s\"\n", d.queued, path);
+	pthread_cond_broadcast(&d.cond);
+	pthread_mutex_unlock(&d.lock);
+	for (t=0; t<workers; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	writeStatus(&d, "stopped");
+
+	while (d.first != NULL) {
+		struct job *j = d.first;
+		d.first = j->next;
+		free(j->name);
+		free(j);
+	}
+	while (d.curves != NULL) {
+		struct curve *c = d.curves;
+		d.curves = c->next;
+		freeCurve(c);
+	}
+	free(threads);
+	close(fd);
+	pthread_mutex_destroy(&d.lock);
+	pthread_cond_destroy(&d.cond);
+
+	return 0;
+}
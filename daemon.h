@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  daemon.h
+ *
+ *    Description:  Spool directory daemon. WAV files which appear in the
+ *                  incoming directory are found by inotify and processed
+ *                  as jobs by persistent pool of worker threads, so FFT
+ *                  plans, octave bands and compiled response curves are
+ *                  made only once for all of them. Knobs of every job are
+ *                  in optional sidecar file, finished outputs are moved
+ *                  into the done directory atomically and state of the
+ *                  daemon is kept in the status file.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+#include "equalizer.h"
+
+
+extern int runDaemon(char *spool, struct octave *oct, int wlen, int workers, char *knobs, double s_value);
+
+#endif
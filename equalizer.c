@@ -29,7 +29,8 @@
  *                  Planck(planckWindow) and Tukey(tukeyWindow). Sound
  *                  modification functions are called Flat(flatBand),
  *                  Peak(peakBand) and Next(nextBand).
- *                  Fourier transform is implemented recursively.
+ *                  Fourier transform is computed by plans from the FFT
+ *                  planner (fft.c).
  *
  *         Author:  Vojtech Vasek
  *
@@ -41,6 +42,7 @@
 #include <stdlib.h>
 
 #include "equalizer.h"
+#include "fft.h"
 #include "my_std.h"
 #include "complex.h"
 #include "string.h"
@@ -172,14 +174,17 @@ struct octave *initOctave(int base, int frac) {
 	recNext(oct, base);
 
 	log_out(65, "Octave [1/%d] length is %d\n", oct->frac, oct->len);
-	struct band *b = oct->head;
-	int i=1;
-	log_out(61, "Bands:\n");
-	while (b != NULL) {
-		log_out(61, "%d. %.2f (%.2f; %.2f)\n", i++, b->center, b->lowerE, b->upperE);
-		b = b->next;
+	/* Do not walk through all bands when they would not be printed */
+	if (log_on(61)) {
+		struct band *b = oct->head;
+		int i=1;
+		log_out(61, "Bands:\n");
+		while (b != NULL) {
+			log_out(61, "%d. %.2f (%.2f; %.2f)\n", i++, b->center, b->lowerE, b->upperE);
+			b = b->next;
+		}
+		log_out(61, "\n");
 	}
-	log_out(61, "\n");
 
 	return oct;
 }
@@ -226,10 +231,11 @@ struct band *getBand(struct octave *oct, int band_id) {
  *  Function useful for finding index in CA array containing
  *   Fourier transform of given frequency.
  *  Returns index, which corresponds to given frequency
- *   in given sample rate.
+ *   in given sample rate. Product is counted in 64 bits, it
+ *   would overflow for long arrays (e.g. dense grid of FIR design).
  */
 int freqToIndex(int freq, int len, int rate) {
-	return ((unsigned int)(freq*len))/(unsigned int)rate;
+	return (int) (((long long) freq*len)/rate);
 }
 
 /*
@@ -284,7 +290,7 @@ void flatBand(C_ARRAY *ca, struct band *b, int srate, double gain) {
 	log_out(31, "fst = %d, ftg = %d\n", fst, ftg);
 
 	int i;
-	for (i=fst; i < ftg; i++) {
+	for (i=fst; i < ftg && i < ca->max; i++) {
 		// For every position, the gain is constant
 		COMPLEX nc = gainToComplex(ca->c[i], gain);
 		setCA(ca, i, nc.re, nc.im);
@@ -305,7 +311,7 @@ void peakBand(C_ARRAY *ca, struct band *b, int srate, double gain) {
 
 	double aktgain;
 	int i;
-	for (i=fst; i < ftg; i++) {
+	for (i=fst; i < ftg && i < ca->max; i++) {
 		// Counts how the gain should look like on this position
 		//  quadratic polynomial is used here
 		aktgain = gain - (gain/pow((ftg-fst)/2, 2))*pow(i-fst-(ftg-fst)/2, 2);
@@ -333,7 +339,7 @@ void nextBand(C_ARRAY *ca, struct band *b, int srate, double gain) {
 	int i;
 	for (i=nfst; i < nftg; i++) {
 		// End of samples, no next band to adjust
-		if (ca->len < i) {
+		if (ca->len <= i) {
 			return;
 		}
 		// Counts how the gain should look like on this position
@@ -401,70 +407,19 @@ void tukeyWindow(C_ARRAY *ca, double alpha) {
 	}
 }
 
-/*
- *  Recursively computes Fourier transform performed on input array "ca"
- *  Operates in O(N*log(N)), where N = ca->len is length of input array.
- *  C_ARRAY *ca - input array of complex numbers i.e. sound track
- */
-static C_ARRAY *recFFT(C_ARRAY *ca) {
-	/*  Round the length of input array to the nearest power of 2 */
-	int n = get_pow(ca->len, 2);
-	C_ARRAY *cy = allocCA(n);
-	cy->len = n;
-
-	if (n == 1) {
-		cy->c[0] = ca->c[0];
-		return cy;
-	}
-
-	C_ARRAY *ca_s = allocCA(n/2);
-	C_ARRAY *ca_l = allocCA(n/2);
-	C_ARRAY *cy_s, *cy_l;
-	
-	/*
-	 * Initialization of arrays:
-	 *   "ca_s" - elements with even index from array "ca"
-	 *   "ca_l" - elements with odd index from array "ca"
-	 */
-	int i;
-	for (i=0; i<n/2; i++) {
-		ca_s->c[ca_s->len++] = ca->c[2*i];
-		ca_l->c[ca_l->len++] = ca->c[2*i + 1];
-	}
-	
-	/* Recursion ready to run */
-	cy_s = recFFT(ca_s);
-	cy_l = recFFT(ca_l);
-	
-	/* Use data computed in recursion */
-	for (i=0; i < n/2; i++) {
-		/* Multiply entries of cy_l by the twiddle factors e^(-2*pi*i/N * k) */
-		cy_l->c[i] = complexMult(polarToComplex(1, -2*M_PI*i/n), cy_l->c[i]);
-	}
-	for (i=0; i < n/2; i++) {
-		cy->c[i] = complexAdd(cy_s->c[i], cy_l->c[i]);
-		cy->c[i + n/2] = complexSub(cy_s->c[i], cy_l->c[i]);
-	}
-
-	/* Release unnecessary memory */
-	freeCA(ca_s); freeCA(ca_l);
-	freeCA(cy_s); freeCA(cy_l);
-
-	return cy;
-}
-
 /*
  *  Counts Fourier transform, also makes scaling
  */
 C_ARRAY *fft(C_ARRAY *ca) {
 	C_ARRAY *car;
-	car = recFFT(ca);
+	car = transform(ca);
 	int len2 = car->max;
 	int i;
 	for (i=0; i<len2; i++) {
-		if (i<len2/2) {
-			car->c[i].re /= len2/4;
-			car->c[i].im /= len2/4;
+		/* Length does not have to be divisible by 4 */
+		if (2*i < len2) {
+			car->c[i].re /= len2/4.0;
+			car->c[i].im /= len2/4.0;
 		}
 		else {
 			car->c[i].re = 0.0;
@@ -480,7 +435,7 @@ C_ARRAY *fft(C_ARRAY *ca) {
  */
 C_ARRAY *ifft(C_ARRAY *ca) {
 	conjugate(ca);
-	C_ARRAY *car = recFFT(ca);
+	C_ARRAY *car = transform(ca);
 	conjugate(ca);
 	int i;
 	for (i=0; i<car->max; i++) {
@@ -490,3 +445,84 @@ C_ARRAY *ifft(C_ARRAY *ca) {
 
 	return car;
 }
+
+/*
+ *  Counts Fourier transform of two real tracks by one transform, the
+ *   first one has to be in real parts of "ca", the second one in its
+ *   imaginary parts. Spectra are separated by conjugate symmetry into
+ *   new arrays "left" and "right", which are scaled like by fft().
+ */
+void fftPair(C_ARRAY *ca, C_ARRAY **left, C_ARRAY **right) {
+	C_ARRAY *car = transform(ca);
+	int len2 = car->max;
+	*left = allocCA(len2);
+	*right = allocCA(len2);
+	(*left)->len = (*right)->len = len2;
+
+	int i;
+	for (i=0; 2*i < len2; i++) {
+		COMPLEX z = car->c[i];
+		COMPLEX zc = car->c[(len2 - i) % len2];
+		/* X = (Z[i] + conj(Z[-i]))/2, Y = (Z[i] - conj(Z[-i]))/2i */
+		setCA(*left, i, (z.re + zc.re)/2.0/(len2/4.0), (z.im - zc.im)/2.0/(len2/4.0));
+		setCA(*right, i, (z.im + zc.im)/2.0/(len2/4.0), (zc.re - z.re)/2.0/(len2/4.0));
+	}
+	freeCA(car);
+}
+
+/*
+ *  Computes invers Fourier transform of two spectra by one transform,
+ *   real part of the result is equal to real part of ifft(left) and
+ *   imaginary part to real part of ifft(right). Spectra are extended to
+ *   conjugate symmetric ones first, so that their transforms are real.
+ */
+C_ARRAY *ifftPair(C_ARRAY *left, C_ARRAY *right) {
+	int len2 = left->len;
+	C_ARRAY *sym = allocCA(len2);
+	sym->len = len2;
+
+	int i;
+	for (i=0; i<len2; i++) {
+		int m = (len2 - i) % len2;
+		/* Spectra l and r are symmetric, so their invers transforms are real */
+		double lre = left->c[i].re + left->c[m].re, lim = left->c[i].im - left->c[m].im;
+		double rre = right->c[i].re + right->c[m].re, rim = right->c[i].im - right->c[m].im;
+		/* Conjugated l + i*r, transform of it is conjugated invers one */
+		setCA(sym, i, lre - rim, -(lim + rre));
+	}
+	C_ARRAY *car = transform(sym);
+	for (i=0; i<len2; i++) {
+		car->c[i].re /= 4.0;
+		car->c[i].im /= -4.0;
+	}
+	freeCA(sym);
+
+	return car;
+}
+
+/*
+ *  Computes plain discrete Fourier transform of "ca" without any
+ *   scaling, all bins of the result are kept. Length of "ca" can be
+ *   any, powers of 2 are the fastest.
+ */
+C_ARRAY *dft(C_ARRAY *ca) {
+	return transform(ca);
+}
+
+/*
+ *  Computes plain inverse discrete Fourier transform of "ca",
+ *   result is scaled by 1/N, so that idft(dft(x)) == x.
+ */
+C_ARRAY *idft(C_ARRAY *ca) {
+	conjugate(ca);
+	C_ARRAY *car = transform(ca);
+	conjugate(ca);
+	conjugate(car);
+	int i;
+	for (i=0; i<car->len; i++) {
+		car->c[i].re /= car->len;
+		car->c[i].im /= car->len;
+	}
+
+	return car;
+}
@@ -70,6 +70,7 @@ extern struct octave *initOctave(int base, int frac);
 extern void freeOctave(struct octave *);
 
 extern struct band *getBand(struct octave *, int band_id);
+extern int freqToIndex(int freq, int len, int rate);
 
 extern void modulateFreq(C_ARRAY *, int st, int tg, double mult, double adit, int srate);
 extern void modulateBand(C_ARRAY *, struct octave *, int index, double mult, double adit, int sample_rate);
@@ -84,5 +85,9 @@ extern void tukeyWindow(C_ARRAY *ca, double alpha);
 
 extern C_ARRAY *fft(C_ARRAY *ca);
 extern C_ARRAY *ifft(C_ARRAY *ca);
+extern void fftPair(C_ARRAY *ca, C_ARRAY **left, C_ARRAY **right);
+extern C_ARRAY *ifftPair(C_ARRAY *left, C_ARRAY *right);
+extern C_ARRAY *dft(C_ARRAY *ca);
+extern C_ARRAY *idft(C_ARRAY *ca);
 
 #endif
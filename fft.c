@@ -0,0 +1,1047 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  fft.c
+ *
+ *    Description:  FFT planner. For every transform size, the fastest of
+ *                  several algorithms (kernels) is found by measuring all
+ *                  of them on the first use of that size. Chosen kernel
+ *                  together with its precomputed tables forms a plan,
+ *                  plans are cached, and the choice of kernels (wisdom)
+ *                  can be saved into file and loaded by later runs, so the
+ *                  measuring is done only once on every machine.
+ *
+ *                  Iterative kernels reorder the input by bit reversal
+ *                  and then do all radix-2 butterfly stages in place.
+ *                  Radix-4 and radix-8 kernels fuse two or three stages
+ *                  into one pass, so the data are loaded from memory less
+ *                  often, while the twiddle factors stay the same.
+ *                  Stockham kernel does not reorder the input at all,
+ *                  every stage reads one array and writes the other one
+ *                  already sorted, both with unit stride. Leaf kernels
+ *                  split the input recursively, but they stop at size of
+ *                  generated codelet (see codelets.h) instead of size 1.
+ *
+ *                  Four-step kernel (six-step by Bailey) is meant for huge
+ *                  transforms, which do not fit into cache. Input of size
+ *                  n1*n2 is viewed as matrix, rows and columns are
+ *                  transformed separately by short cache friendly
+ *                  transforms, columns are turned into rows by blocked
+ *                  transposes. All rows and transposes are split among
+ *                  "fft_threads" threads.
+ *
+ *                  Sizes, which are not power of 2, are computed either by
+ *                  mixed radix kernel (if all prime factors are 2, 3, 5
+ *                  or 7), or by Bluestein kernel, which turns transform
+ *                  of any size into convolution computed by transforms
+ *                  of power of 2.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "fft.h"
+#include "codelets.h"
+#include "complex.h"
+#include "prof.h"
+#include "my_std.h"
+
+/* Minimal time of measuring of one kernel (in ns) */
+#define MEASURE_TIME 2000000ULL
+/* Minimal number of runs of one kernel when measuring */
+#define MEASURE_RUNS 3
+/* Smaller sizes are not worth measuring */
+#define MEASURE_MIN 4
+/* Bigger sizes take too long to measure, the estimate is used */
+#define MEASURE_MAX (1 << 20)
+/* Maximal time of measuring of all kernels for one size (in ns) */
+#define MEASURE_BUDGET 1000000000ULL
+/* Largest number of fused stages (radix-8 ~ 2^3) */
+#define MAX_FUSED 3
+/* Four-step kernel is measured only for sizes from this one */
+#define FOURSTEP_MIN (1 << 14)
+/* Size of tile of blocked transpose */
+#define TILE 32
+/* The biggest radix of mixed radix kernel */
+#define MAX_RADIX 7
+/* Maximal number of stages of mixed radix kernel */
+#define MAX_FACTORS 32
+
+
+/*
+ *  Kernel chosen for one size of the transform.
+ */
+struct wisdom {
+	int n;
+	enum fft_kernel kernel;
+	struct wisdom *next;
+};
+
+/* Names of the kernels used in wisdom file */
+static const char *kernel_names[KERNELS] = {
+	"recursive", "radix2", "radix4", "radix8", "stockham", "leaf16", "leaf32", "leaf64", "fourstep",
+	"mixed", "bluestein"
+};
+
+/* How the kernel is chosen for sizes without wisdom */
+enum plan_mode plan_mode = PLAN_MEASURE;
+/* Kernel used for all sizes regardless of wisdom, -1 if not set */
+int forced_kernel = -1;
+/* Number of threads used by four-step kernel, 0 means all processors */
+int fft_threads = 0;
+
+/* Cache of all plans already made */
+static struct fft_plan *plans = NULL;
+/* All known kernel choices */
+static struct wisdom *wisdoms = NULL;
+/* Set to 1 when some kernel was measured and not saved yet */
+static int wisdom_changed = 0;
+/* Plans and wisdom can be used by more threads, the lock is recursive for Bluestein plans */
+static pthread_mutex_t plans_lock;
+static pthread_once_t plans_once = PTHREAD_ONCE_INIT;
+
+
+/*
+ *  Initializes recursive lock of the plans.
+ */
+static void initPlansLock(void) {
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&plans_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static void lockPlans(void) {
+	pthread_once(&plans_once, initPlansLock);
+	pthread_mutex_lock(&plans_lock);
+}
+
+static void unlockPlans(void) {
+	pthread_mutex_unlock(&plans_lock);
+}
+
+/*
+ *  Returns name of given kernel.
+ */
+const char *kernelName(enum fft_kernel kernel) {
+	return kernel_names[kernel];
+}
+
+/*
+ *  Returns kernel with given name, -1 if there is no such kernel.
+ */
+int kernelByName(const char *name) {
+	int k;
+	for (k=0; k<KERNELS; k++) {
+		if (strcmp(name, kernel_names[k]) == 0) {
+			return k;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ *  Recursively computes Fourier transform performed on input array "ca"
+ *  Operates in O(N*log(N)), where N = ca->len is length of input array.
+ *  C_ARRAY *ca - input array of complex numbers i.e. sound track
+ */
+static C_ARRAY *recFFT(C_ARRAY *ca) {
+	/*  Round the length of input array to the nearest power of 2 */
+	int n = get_pow(ca->len, 2);
+	C_ARRAY *cy = allocCA(n);
+	cy->len = n;
+
+	if (n == 1) {
+		cy->c[0] = ca->c[0];
+		return cy;
+	}
+
+	C_ARRAY *ca_s = allocCA(n/2);
+	C_ARRAY *ca_l = allocCA(n/2);
+	C_ARRAY *cy_s, *cy_l;
+	
+	/*
+	 * Initialization of arrays:
+	 *   "ca_s" - elements with even index from array "ca"
+	 *   "ca_l" - elements with odd index from array "ca"
+	 */
+	int i;
+	for (i=0; i<n/2; i++) {
+		ca_s->c[ca_s->len++] = ca->c[2*i];
+		ca_l->c[ca_l->len++] = ca->c[2*i + 1];
+	}
+	
+	/* Recursion ready to run */
+	cy_s = recFFT(ca_s);
+	cy_l = recFFT(ca_l);
+	
+	/* Use data computed in recursion */
+	for (i=0; i < n/2; i++) {
+		/* Multiply entries of cy_l by the twiddle factors e^(-2*pi*i/N * k) */
+		cy_l->c[i] = complexMult(polarToComplex(1, -2*M_PI*i/n), cy_l->c[i]);
+	}
+	for (i=0; i < n/2; i++) {
+		cy->c[i] = complexAdd(cy_s->c[i], cy_l->c[i]);
+		cy->c[i + n/2] = complexSub(cy_s->c[i], cy_l->c[i]);
+	}
+
+	/* Release unnecessary memory */
+	freeCA(ca_s); freeCA(ca_l);
+	freeCA(cy_s); freeCA(cy_l);
+
+	return cy;
+}
+
+/*
+ *  Does "r" successive radix-2 stages in one pass over array "x" of "n"
+ *   elements, the first of them combines blocks of "h" elements. Every
+ *   group of 2^r elements with distance "h" is loaded only once.
+ */
+static void fusedStages(COMPLEX *x, int n, COMPLEX *tw, int h, int r) {
+	COMPLEX v[1 << MAX_FUSED];
+	int g = h << r;      /* Size of the block after this pass */
+	int cnt = 1 << r;    /* Number of loaded elements */
+	int k, j, m, s;
+
+	for (k=0; k<n; k+=g) {
+		for (j=0; j<h; j++) {
+			for (m=0; m<cnt; m++) {
+				v[m] = x[k + j + m*h];
+			}
+			for (s=0; s<r; s++) {
+				int span = 1 << s;
+				/* Twiddles of this stage are e^(-2*pi*i*p/(2*h*span)) */
+				int stride = n/(2*h*span);
+				for (m=0; m<cnt; m++) {
+					if (m & span) {
+						continue;
+					}
+					COMPLEX w = tw[(j + (m & (span - 1))*h)*stride];
+					COMPLEX *a = &v[m], *b = &v[m + span];
+					double tre = w.re*b->re - w.im*b->im;
+					double tim = w.re*b->im + w.im*b->re;
+					b->re = a->re - tre; b->im = a->im - tim;
+					a->re += tre; a->im += tim;
+				}
+			}
+			for (m=0; m<cnt; m++) {
+				x[k + j + m*h] = v[m];
+			}
+		}
+	}
+}
+
+/*
+ *  Does all stages of self-sorting Stockham transform of "n" elements,
+ *   data are moved between arrays "x" and "y" in every stage, so the
+ *   result ends in "x" if the number of stages is even, in "y" otherwise.
+ *   Stage with sub-transforms of length "len" and stride "s" reads
+ *   halves of the sub-transforms and writes their butterflies next
+ *   to each other, the innermost loop goes through "s" neighbours.
+ */
+static void stockham(COMPLEX *x, COMPLEX *y, int n, COMPLEX *tw) {
+	int len, s, p, q;
+	for (len=n, s=1; len > 1; len /= 2, s *= 2) {
+		int m = len/2;
+		for (p=0; p<m; p++) {
+			/* e^(-2*pi*i*p/len) */
+			COMPLEX w = tw[p*s];
+			COMPLEX *xa = x + s*p;
+			COMPLEX *xb = x + s*(p + m);
+			COMPLEX *ya = y + s*2*p;
+			COMPLEX *yb = y + s*(2*p + 1);
+			for (q=0; q<s; q++) {
+				double dre = xa[q].re - xb[q].re;
+				double dim = xa[q].im - xb[q].im;
+				ya[q].re = xa[q].re + xb[q].re;
+				ya[q].im = xa[q].im + xb[q].im;
+				yb[q].re = dre*w.re - dim*w.im;
+				yb[q].im = dre*w.im + dim*w.re;
+			}
+		}
+		COMPLEX *tmp = x;
+		x = y;
+		y = tmp;
+	}
+}
+
+/*
+ *  Computes transform of "n" elements of "in" with stride "is" into
+ *   "out" by recursive decimation in time. Halves are transformed
+ *   directly into the halves of "out", codelet is used when "n" is not
+ *   bigger than "leaf". Twiddle factors for size "n" are taken from
+ *   table "tw" with stride "ts". Argument "lg" is log2(n).
+ */
+static void leafFFT(const COMPLEX *in, int is, COMPLEX *out, int n, int lg, int leaf, COMPLEX *tw, int ts) {
+	if (n <= leaf) {
+		codelets[lg](in, is, out);
+		return;
+	}
+
+	int h = n/2;
+	leafFFT(in, 2*is, out, h, lg - 1, leaf, tw, 2*ts);
+	leafFFT(in + is, 2*is, out + h, h, lg - 1, leaf, tw, 2*ts);
+
+	int k;
+	for (k=0; k<h; k++) {
+		COMPLEX w = tw[k*ts];
+		COMPLEX *a = &out[k], *b = &out[k + h];
+		double tre = w.re*b->re - w.im*b->im;
+		double tim = w.re*b->im + w.im*b->re;
+		b->re = a->re - tre; b->im = a->im - tim;
+		a->re += tre; a->im += tim;
+	}
+}
+
+/*
+ *  Computes transform of "n" elements of "in" with stride "is" into
+ *   "out" by recursive decimation in time with radices "factors". For
+ *   radix p, p sub-transforms of every p-th element are stored one
+ *   after another into "out" and then combined by p-point transforms.
+ *   Twiddle factors for size "n" are in table "tw" with stride "ts".
+ */
+static void mixedFFT(const COMPLEX *in, int is, COMPLEX *out, int n, const int *factors, COMPLEX *tw, int ts) {
+	if (n == 1) {
+		out[0] = in[0];
+		return;
+	}
+
+	int p = factors[0];
+	int m = n/p;
+	int q, r, k;
+	for (q=0; q<p; q++) {
+		mixedFFT(in + q*is, p*is, out + q*m, m, factors + 1, tw, ts*p);
+	}
+
+	COMPLEX t[MAX_RADIX];
+	int root = m*ts;  /* e^(-2*pi*i/p) is on index root*1 */
+	for (k=0; k<m; k++) {
+		for (q=0; q<p; q++) {
+			t[q] = complexMult(tw[q*k*ts], out[q*m + k]);
+		}
+		for (r=0; r<p; r++) {
+			COMPLEX sum = t[0];
+			for (q=1; q<p; q++) {
+				COMPLEX w = tw[((q*r) % p)*root];
+				sum.re += w.re*t[q].re - w.im*t[q].im;
+				sum.im += w.re*t[q].im + w.im*t[q].re;
+			}
+			out[r*m + k] = sum;
+		}
+	}
+}
+
+/*
+ *  Computes transform of "n" elements of "src" into "out" by Bluestein
+ *   algorithm. Product of input and chirp is convolved with conjugated
+ *   chirp by transforms of plan "sub1", result is multiplied by chirp.
+ */
+static void bluestein(struct fft_plan *plan, const COMPLEX *src, COMPLEX *out) {
+	int n = plan->n;
+	int m = plan->sub1->n;
+	int i;
+
+	C_ARRAY *a = allocCA(m);
+	a->len = m;
+	for (i=0; i<n; i++) {
+		a->c[i] = complexMult(src[i], plan->chirp[i]);
+	}
+	C_ARRAY *spec = runPlan(plan->sub1, a);
+	/* Inverse transform is done by conjugation */
+	for (i=0; i<m; i++) {
+		spec->c[i] = complexMult(spec->c[i], plan->bspec->c[i]);
+		spec->c[i].im = -spec->c[i].im;
+	}
+	C_ARRAY *conv = runPlan(plan->sub1, spec);
+	for (i=0; i<n; i++) {
+		COMPLEX v = {conv->c[i].re/m, -conv->c[i].im/m};
+		out[i] = complexMult(v, plan->chirp[i]);
+	}
+
+	freeCA(a); freeCA(spec); freeCA(conv);
+}
+
+/*
+ *  Returns 1 if "n" is power of 2, 0 otherwise.
+ */
+static int isPow2(int n) {
+	return n > 0 && (n & (n - 1)) == 0;
+}
+
+/*
+ *  Splits "n" into radices of mixed radix kernel and stores them into
+ *   "factors", 4 goes first. Returns number of radices, -1 if "n" has
+ *   other prime factor than 2, 3, 5 or 7.
+ */
+static int factorize(int n, int *factors) {
+	static const int radices[] = {4, 2, 3, 5, 7};
+	int count = 0;
+	int r;
+	for (r=0; r<5; r++) {
+		while (n % radices[r] == 0 && count < MAX_FACTORS) {
+			factors[count++] = radices[r];
+			n /= radices[r];
+		}
+	}
+
+	return (n == 1) ? count : -1;
+}
+
+/*
+ *  Returns 1 if given kernel can compute transform of size "n".
+ */
+static int kernelFits(enum fft_kernel kernel, int n) {
+	int factors[MAX_FACTORS];
+	if (kernel == KERNEL_BLUESTEIN) {
+		return 1;
+	}
+	if (kernel == KERNEL_MIXED) {
+		return factorize(n, factors) >= 0;
+	}
+
+	return isPow2(n);
+}
+
+/*
+ *  Returns pointer to "n" elements of input array "ca", if the array
+ *   is shorter, it is padded by zeros into new array "pad" (which has
+ *   to be released then), otherwise "pad" is set to NULL.
+ */
+static const COMPLEX *inputOf(C_ARRAY *ca, int n, C_ARRAY **pad) {
+	*pad = NULL;
+	if (ca->max >= n) {
+		return ca->c;
+	}
+
+	*pad = allocCA(n);
+	int i;
+	for (i=0; i < ca->max; i++) {
+		(*pad)->c[i] = ca->c[i];
+	}
+
+	return (*pad)->c;
+}
+
+/*
+ *  Part of work done by one thread, items from "from" to "to".
+ */
+struct task {
+	void (*body)(void *ctx, int from, int to);
+	void *ctx;
+	int from;
+	int to;
+};
+
+/*
+ *  Arguments of one step of four-step kernel.
+ */
+struct step {
+	COMPLEX *src;          /* Matrix with "rows" rows of "cols" elements */
+	COMPLEX *dst;
+	int rows;
+	int cols;
+	struct fft_plan *sub;  /* Plan for transforms of rows */
+	struct fft_plan *plan; /* Plan of the whole transform, for twiddle factors */
+};
+
+/*
+ *  Body of one thread, it runs function of its task.
+ */
+static void *runTask(void *arg) {
+	struct task *t = (struct task *) arg;
+	t->body(t->ctx, t->from, t->to);
+	return NULL;
+}
+
+/*
+ *  Returns number of threads of parallelFor.
+ */
+static int threadCount(void) {
+	return (fft_threads > 0) ? fft_threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+/*
+ *  Calls "body" for items from 0 to "count", items are split evenly
+ *   among "fft_threads" threads, the calling thread is one of them.
+ *   Used also for other work, which can be split into independent items.
+ */
+void parallelFor(int count, void (*body)(void *, int, int), void *ctx) {
+	int nt = MAX(MIN(threadCount(), count), 1);
+	struct task *tasks;
+	pthread_t *threads;
+	if ((tasks = (struct task *) malloc(nt * sizeof(struct task))) == NULL ||
+	    (threads = (pthread_t *) malloc(nt * sizeof(pthread_t))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+
+	int t;
+	for (t=0; t<nt; t++) {
+		tasks[t].body = body;
+		tasks[t].ctx = ctx;
+		tasks[t].from = (int) ((long long) count*t/nt);
+		tasks[t].to = (int) ((long long) count*(t + 1)/nt);
+	}
+	/* If the thread can not be created, its work is done by this one */
+	for (t=1; t<nt; t++) {
+		if (pthread_create(&threads[t], NULL, runTask, &tasks[t]) != 0) {
+			runTask(&tasks[t]);
+			tasks[t].body = NULL;
+		}
+	}
+	runTask(&tasks[0]);
+	for (t=1; t<nt; t++) {
+		if (tasks[t].body != NULL) {
+			pthread_join(threads[t], NULL);
+		}
+	}
+
+	free(tasks); free(threads);
+}
+
+/*
+ *  Transposes tiles of rows from "from" to "to" (in units of TILE rows)
+ *   of matrix "src" into "dst".
+ */
+static void transposeTiles(void *ctx, int from, int to) {
+	struct step *st = (struct step *) ctx;
+	int r0, c0, r, c;
+	for (r0=from*TILE; r0 < to*TILE && r0 < st->rows; r0 += TILE) {
+		for (c0=0; c0 < st->cols; c0 += TILE) {
+			for (r=r0; r < r0 + TILE && r < st->rows; r++) {
+				for (c=c0; c < c0 + TILE && c < st->cols; c++) {
+					st->dst[c*st->rows + r] = st->src[r*st->cols + c];
+				}
+			}
+		}
+	}
+}
+
+/*
+ *  Transforms rows from "from" to "to" of matrix "src" into "dst",
+ *   if plan of the whole transform is given, element in row "r" and
+ *   column "k" is multiplied by its twiddle factor e^(-2*pi*i*r*k/n).
+ */
+static void transformRows(void *ctx, int from, int to) {
+	struct step *st = (struct step *) ctx;
+	int lg = 0;
+	while ((1 << lg) < st->cols) {
+		lg++;
+	}
+
+	int r, k;
+	for (r=from; r<to; r++) {
+		COMPLEX *row = st->dst + r*st->cols;
+		leafFFT(st->src + r*st->cols, 1, row, st->cols, lg, CODELET_MAX, st->sub->tw, 1);
+		if (st->plan == NULL) {
+			continue;
+		}
+		int n = st->plan->n;
+		for (k=1; k < st->cols; k++) {
+			int e = r*k;
+			COMPLEX w = st->plan->tw[e % (n/2)];
+			if (e >= n/2) {
+				w.re = -w.re; w.im = -w.im;
+			}
+			double re = row[k].re*w.re - row[k].im*w.im;
+			row[k].im = row[k].re*w.im + row[k].im*w.re;
+			row[k].re = re;
+		}
+	}
+}
+
+/*
+ *  Computes transform of "src" into "out" by four-step kernel, both
+ *   arrays have size of the plan. Array "tmp" of the same size is used
+ *   for intermediate results.
+ */
+static void fourStep(struct fft_plan *plan, const COMPLEX *src, COMPLEX *out, COMPLEX *tmp) {
+	int n1 = plan->n1, n2 = plan->n2;
+	struct step st;
+
+	/* Columns of input matrix with n1 rows become rows */
+	st.src = (COMPLEX *) src; st.dst = out; st.rows = n1; st.cols = n2;
+	parallelFor((n1 + TILE - 1)/TILE, transposeTiles, &st);
+	/* Transform them and multiply by twiddle factors */
+	st.src = out; st.dst = tmp; st.rows = n2; st.cols = n1;
+	st.sub = plan->sub1; st.plan = plan;
+	parallelFor(n2, transformRows, &st);
+	/* Back to columns */
+	st.src = tmp; st.dst = out;
+	parallelFor((n2 + TILE - 1)/TILE, transposeTiles, &st);
+	/* Transform original rows */
+	st.src = out; st.dst = tmp; st.rows = n1; st.cols = n2;
+	st.sub = plan->sub2; st.plan = NULL;
+	parallelFor(n1, transformRows, &st);
+	/* Result is stored by columns */
+	st.src = tmp; st.dst = out;
+	parallelFor((n1 + TILE - 1)/TILE, transposeTiles, &st);
+}
+
+/*
+ *  Creates plan for transform of size "n" with given kernel, which
+ *   must fit that size, tables of the plan are precomputed here.
+ */
+struct fft_plan *makePlan(int n, enum fft_kernel kernel) {
+	struct fft_plan *plan;
+	/* Mixed radix kernel needs whole circle of twiddle factors */
+	int twlen = (kernel == KERNEL_MIXED) ? n : MAX(n/2, 1);
+	if ((plan = (struct fft_plan *) malloc(sizeof(struct fft_plan))) == NULL ||
+	    (plan->tw = (COMPLEX *) malloc(twlen * sizeof(COMPLEX))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	plan->n = n;
+	plan->kernel = kernel;
+	plan->next = NULL;
+	plan->perm = NULL;
+	plan->factors = NULL;
+	plan->chirp = NULL;
+	plan->bspec = NULL;
+	plan->sub1 = plan->sub2 = NULL;
+
+	int bits = 0;
+	while ((1 << bits) < n) {
+		bits++;
+	}
+	/* Only in-place kernels need to reorder the input */
+	int i, b;
+	if (kernel >= KERNEL_RADIX2 && kernel <= KERNEL_RADIX8 &&
+	    (plan->perm = (int *) malloc(n * sizeof(int))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	for (i=0; i < n && plan->perm != NULL; i++) {
+		int rev = 0;
+		for (b=0; b<bits; b++) {
+			rev |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		plan->perm[i] = rev;
+	}
+	for (i=0; i < twlen; i++) {
+		plan->tw[i].re = cos(2*M_PI*i/n);
+		plan->tw[i].im = -sin(2*M_PI*i/n);
+	}
+	/* Rows should be as square as possible */
+	if (kernel == KERNEL_FOURSTEP) {
+		plan->n1 = 1 << (bits/2);
+		plan->n2 = n/plan->n1;
+		plan->sub1 = makePlan(plan->n1, KERNEL_LEAF64);
+		plan->sub2 = makePlan(plan->n2, KERNEL_LEAF64);
+	}
+	if (kernel == KERNEL_MIXED) {
+		if ((plan->factors = (int *) malloc(MAX_FACTORS * sizeof(int))) == NULL) {
+			perror("malloc");
+			exit (ERROR_EXIT_CODE);
+		}
+		factorize(n, plan->factors);
+	}
+	/* Convolution has to be long enough not to wrap around, its cached plan can use threads */
+	if (kernel == KERNEL_BLUESTEIN) {
+		int m = get_pow(2*n - 1, 2);
+		plan->sub1 = getPlan(m);
+		if ((plan->chirp = (COMPLEX *) malloc(n * sizeof(COMPLEX))) == NULL) {
+			perror("malloc");
+			exit (ERROR_EXIT_CODE);
+		}
+		C_ARRAY *b = allocCA(m);
+		b->len = m;
+		for (i=0; i<n; i++) {
+			/* k^2 modulo 2n keeps the angle precise for big k */
+			long long k2 = ((long long) i*i) % (2LL*n);
+			plan->chirp[i].re = cos(M_PI*k2/n);
+			plan->chirp[i].im = -sin(M_PI*k2/n);
+			setCA(b, i, plan->chirp[i].re, -plan->chirp[i].im);
+			if (i > 0) {
+				setCA(b, m - i, plan->chirp[i].re, -plan->chirp[i].im);
+			}
+		}
+		plan->bspec = runPlan(plan->sub1, b);
+		freeCA(b);
+	}
+
+	return plan;
+}
+
+/*
+ *  Releases memory of one plan.
+ */
+void freePlan(struct fft_plan *plan) {
+	/* Convolution plan of Bluestein kernel stays in the cache */
+	if (plan->sub1 != NULL && plan->kernel != KERNEL_BLUESTEIN) {
+		freePlan(plan->sub1);
+	}
+	if (plan->sub2 != NULL) {
+		freePlan(plan->sub2);
+	}
+	free(plan->factors);
+	free(plan->chirp);
+	if (plan->bspec != NULL) {
+		freeCA(plan->bspec);
+	}
+	free(plan->perm);
+	free(plan->tw);
+	free(plan);
+}
+
+/*
+ *  Computes discrete Fourier transform of "ca" by given plan, input
+ *   is padded by zeros to the size of the plan. Returns new array
+ *   with unscaled result.
+ */
+C_ARRAY *runPlan(struct fft_plan *plan, C_ARRAY *ca) {
+	if (plan->kernel == KERNEL_RECURSIVE) {
+		return recFFT(ca);
+	}
+
+	int n = plan->n;
+	C_ARRAY *cy = allocCA(n);
+	cy->len = n;
+	int i;
+
+	/* These kernels only read the input, it is copied only if it has to be padded */
+	if (plan->kernel >= KERNEL_LEAF16) {
+		C_ARRAY *pad;
+		const COMPLEX *src = inputOf(ca, n, &pad);
+		if (plan->kernel == KERNEL_FOURSTEP) {
+			C_ARRAY *work = allocCA(n);
+			fourStep(plan, src, cy->c, work->c);
+			freeCA(work);
+		} else if (plan->kernel == KERNEL_MIXED) {
+			mixedFFT(src, 1, cy->c, n, plan->factors, plan->tw, 1);
+		} else if (plan->kernel == KERNEL_BLUESTEIN) {
+			bluestein(plan, src, cy->c);
+		} else {
+			int lg = 0;
+			while ((1 << lg) < n) {
+				lg++;
+			}
+			leafFFT(src, 1, cy->c, n, lg, 16 << (plan->kernel - KERNEL_LEAF16), plan->tw, 1);
+		}
+		if (pad != NULL) {
+			freeCA(pad);
+		}
+
+		return cy;
+	}
+
+	if (plan->kernel == KERNEL_STOCKHAM) {
+		C_ARRAY *tmp = allocCA(n);
+		int stages = 0;
+		for (i=1; i<n; i*=2) {
+			stages++;
+		}
+		/* Start in the array, where the result should not end */
+		C_ARRAY *x = (stages % 2) ? tmp : cy;
+		C_ARRAY *y = (stages % 2) ? cy : tmp;
+		for (i=0; i < n && i < ca->max; i++) {
+			x->c[i] = ca->c[i];
+		}
+		stockham(x->c, y->c, n, plan->tw);
+		freeCA(tmp);
+
+		return cy;
+	}
+
+	for (i=0; i < n && i < ca->max; i++) {
+		cy->c[plan->perm[i]] = ca->c[i];
+	}
+
+	/* Number of stages fused into one pass */
+	int fused = (plan->kernel == KERNEL_RADIX8) ? 3 : (plan->kernel == KERNEL_RADIX4) ? 2 : 1;
+	int h = 1;
+	while (h < n) {
+		int r = 0;
+		while (r < fused && (h << (r + 1)) <= n) {
+			r++;
+		}
+		fusedStages(cy->c, n, plan->tw, h, r);
+		h <<= r;
+	}
+
+	return cy;
+}
+
+/*
+ *  Returns kernel for size "n" without measuring, sizes too big to be
+ *   measured are split among threads, if there are more of them.
+ */
+static enum fft_kernel estimateKernel(int n) {
+	if (isPow2(n)) {
+		return (n > MEASURE_MAX && threadCount() > 1) ? KERNEL_FOURSTEP : KERNEL_STOCKHAM;
+	}
+
+	return kernelFits(KERNEL_MIXED, n) ? KERNEL_MIXED : KERNEL_BLUESTEIN;
+}
+
+/*
+ *  Returns 1 if kernel should be measured for size "n". Recursive,
+ *   mixed radix and Bluestein kernels can never beat the others on
+ *   sizes of power of 2, Bluestein kernel can not beat mixed radix.
+ */
+static int worthMeasuring(enum fft_kernel kernel, int n) {
+	if (!kernelFits(kernel, n) || (kernel == KERNEL_FOURSTEP && n < FOURSTEP_MIN)) {
+		return 0;
+	}
+	if (isPow2(n)) {
+		return kernel != KERNEL_RECURSIVE && kernel != KERNEL_MIXED && kernel != KERNEL_BLUESTEIN;
+	}
+
+	return kernel != KERNEL_BLUESTEIN || !kernelFits(KERNEL_MIXED, n);
+}
+
+/*
+ *  Returns the fastest kernel for size "n", kernels are measured on
+ *   random input until MEASURE_BUDGET is spent. Newer kernels are
+ *   usually faster, so they go first.
+ */
+static enum fft_kernel measureKernels(int n) {
+	/* There is nothing to choose from */
+	int k, count = 0;
+	enum fft_kernel only = estimateKernel(n);
+	for (k=0; k<KERNELS; k++) {
+		if (worthMeasuring(k, n)) {
+			only = k;
+			count++;
+		}
+	}
+	if (count < 2) {
+		return only;
+	}
+
+	C_ARRAY *in = allocCA(n);
+	in->len = n;
+	int i;
+	for (i=0; i<n; i++) {
+		setCA(in, i, rand()/(double) RAND_MAX - 0.5, 0.0);
+	}
+
+	enum fft_kernel best = estimateKernel(n);
+	unsigned long long best_ns = 0, spent = 0;
+	for (k=KERNELS-1; k >= 0; k--) {
+		if (!worthMeasuring(k, n)) {
+			continue;
+		}
+		if (spent >= MEASURE_BUDGET) {
+			log_out(45, "Time for measuring FFT of size %d is spent, %s kernel is not measured\n", n, kernelName(k));
+			continue;
+		}
+		unsigned long long t0 = profNow();
+		struct fft_plan *plan = makePlan(n, k);
+		/* Warm up caches */
+		freeCA(runPlan(plan, in));
+		spent += profNow() - t0;
+
+		unsigned long long ns = 0, total = 0;
+		int runs;
+		for (runs=0; runs < MEASURE_RUNS || total < MEASURE_TIME; runs++) {
+			t0 = profNow();
+			freeCA(runPlan(plan, in));
+			unsigned long long t = profNow() - t0;
+			ns = (runs == 0) ? t : MIN(ns, t);
+			total += t;
+			if (spent + total >= MEASURE_BUDGET) {
+				break;
+			}
+		}
+		spent += total;
+		log_out(45, "FFT of size %d by %s kernel takes %.3fus\n", n, kernelName(k), ns*1e-3);
+		if (best_ns == 0 || ns < best_ns) {
+			best_ns = ns;
+			best = k;
+		}
+		freePlan(plan);
+	}
+	freeCA(in);
+
+	return best;
+}
+
+/*
+ *  Returns kernel for size "n", either from wisdom, or chosen by
+ *   selected planning mode. New choices are added to the wisdom.
+ */
+static enum fft_kernel chooseKernel(int n) {
+	if (forced_kernel >= 0 && kernelFits(forced_kernel, n)) {
+		return forced_kernel;
+	}
+
+	struct wisdom *w;
+	for (w=wisdoms; w != NULL; w=w->next) {
+		if (w->n == n) {
+			return w->kernel;
+		}
+	}
+
+	if (plan_mode == PLAN_ESTIMATE || n < MEASURE_MIN || n > MEASURE_MAX) {
+		return estimateKernel(n);
+	}
+
+	if ((w = (struct wisdom *) malloc(sizeof(struct wisdom))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	w->n = n;
+	w->kernel = measureKernels(n);
+	w->next = wisdoms;
+	wisdoms = w;
+	wisdom_changed = 1;
+	log_out(55, "Using %s kernel for FFT of size %d\n", kernelName(w->kernel), n);
+
+	return w->kernel;
+}
+
+/*
+ *  Returns plan for size "n" from the cache, new plan is made if
+ *   there is none yet.
+ */
+struct fft_plan *getPlan(int n) {
+	lockPlans();
+	struct fft_plan *plan;
+	for (plan=plans; plan != NULL; plan=plan->next) {
+		if (plan->n == n) {
+			break;
+		}
+	}
+	if (plan == NULL) {
+		plan = makePlan(n, chooseKernel(n));
+		plan->next = plans;
+		plans = plan;
+	}
+	unlockPlans();
+
+	return plan;
+}
+
+/*
+ *  Computes discrete Fourier transform of all "ca->len" elements of
+ *   "ca" by plan from the cache. Returns new array with unscaled result.
+ */
+C_ARRAY *transform(C_ARRAY *ca) {
+	return runPlan(getPlan(MAX(ca->len, 1)), ca);
+}
+
+/*
+ *  Releases all cached plans and all wisdom.
+ */
+void freePlans(void) {
+	lockPlans();
+	while (plans != NULL) {
+		struct fft_plan *plan = plans;
+		plans = plan->next;
+		freePlan(plan);
+	}
+	while (wisdoms != NULL) {
+		struct wisdom *w = wisdoms;
+		wisdoms = w->next;
+		free(w);
+	}
+	unlockPlans();
+}
+
+/*
+ *  Loads kernel choices from wisdom file "fpath", every line contains
+ *   size of the transform and name of the kernel, lines starting with
+ *   '#' are comments. Returns number of loaded choices, -1 if file
+ *   can not be read.
+ */
+int loadWisdom(char *fpath) {
+	FILE *fin;
+	if ((fin = fopen(fpath, "r")) == NULL) {
+		return -1;
+	}
+
+	char line[128], name[32];
+	int n, count = 0;
+	while (fgets(line, sizeof(line), fin) != NULL) {
+		if (line[0] == '#' || sscanf(line, "%d %31s", &n, name) != 2) {
+			continue;
+		}
+		int k = kernelByName(name);
+		if (k < 0 || n < 1 || !kernelFits(k, n)) {
+			fprintf(stderr, "Ignoring unknown wisdom \"%s\" for size %d\n", name, n);
+			continue;
+		}
+
+		struct wisdom *w;
+		if ((w = (struct wisdom *) malloc(sizeof(struct wisdom))) == NULL) {
+			perror("malloc");
+			exit (ERROR_EXIT_CODE);
+		}
+		w->n = n;
+		w->kernel = k;
+		lockPlans();
+		w->next = wisdoms;
+		wisdoms = w;
+		unlockPlans();
+		count++;
+	}
+	fclose(fin);
+	log_out(45, "Loaded %d FFT kernel choices from \"%s\"\n", count, fpath);
+
+	return count;
+}
+
+/*
+ *  Returns 1 if some kernel was measured since the wisdom was loaded
+ *   or saved, 0 otherwise.
+ */
+int newWisdom(void) {
+	return wisdom_changed;
+}
+
+/*
+ *  Writes all known kernel choices into wisdom file "fpath".
+ *   Returns 0 on success, -1 otherwise.
+ */
+int saveWisdom(char *fpath) {
+	FILE *fout;
+	if ((fout = fopen(fpath, "w")) == NULL) {
+		perror("fopen");
+		return -1;
+	}
+
+	fprintf(fout, "# befft FFT wisdom\n# size kernel\n");
+	lockPlans();
+	struct wisdom *w;
+	for (w=wisdoms; w != NULL; w=w->next) {
+		fprintf(fout, "%d %s\n", w->n, kernel_names[w->kernel]);
+	}
+	wisdom_changed = 0;
+	unlockPlans();
+
+	if (fclose(fout) == EOF) {
+		perror("fclose");
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  fft.h
+ *
+ *    Description:  FFT planner. For every transform size, the fastest of
+ *                  several algorithms (kernels) is found by measuring all
+ *                  of them on the first use of that size. Chosen kernel
+ *                  together with its precomputed tables forms a plan,
+ *                  plans are cached, and the choice of kernels (wisdom)
+ *                  can be saved into file and loaded by later runs, so the
+ *                  measuring is done only once on every machine.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef FFT_H_
+#define FFT_H_
+
+#include "complex.h"
+
+/* Default file with the fastest FFT kernels for this machine */
+#define DEFAULT_WISDOM "befft.wisdom"
+
+/*
+ *  Algorithms, which can be used to compute the transform.
+ */
+enum fft_kernel {
+	KERNEL_RECURSIVE = 0, /* Original recursive radix-2, new arrays in every level */
+	KERNEL_RADIX2 = 1,    /* In-place iterative radix-2 */
+	KERNEL_RADIX4 = 2,    /* In-place, two radix-2 stages fused into one pass */
+	KERNEL_RADIX8 = 3,    /* In-place, three radix-2 stages fused into one pass */
+	KERNEL_STOCKHAM = 4,  /* Self-sorting radix-2 between two arrays, no bit reversal */
+	KERNEL_LEAF16 = 5,    /* Recursive without allocations, codelets of size 16 in leaves */
+	KERNEL_LEAF32 = 6,    /* The same with codelets of size 32 */
+	KERNEL_LEAF64 = 7,    /* The same with codelets of size 64 */
+	KERNEL_FOURSTEP = 8,  /* Rows and columns of matrix transformed separately by more threads */
+	KERNEL_MIXED = 9,     /* Mixed radix 4, 2, 3, 5 and 7, for sizes without other prime factors */
+	KERNEL_BLUESTEIN = 10, /* Any size, computed as convolution by transforms of power of 2 */
+	KERNELS = 11,         /* Number of kernels, not a kernel itself */
+};
+
+/*
+ *  How the kernel is chosen for sizes without wisdom.
+ */
+enum plan_mode {
+	PLAN_ESTIMATE = 0, /* Use kernel which is usually the fastest */
+	PLAN_MEASURE = 1,  /* Measure all kernels and use the fastest one */
+};
+
+/*
+ *  Plan of the transform of one size, it stores everything, what
+ *   can be computed before the input is known.
+ */
+struct fft_plan {
+	int n;                 /* Size of the transform */
+	enum fft_kernel kernel;
+	int *perm;             /* Bit reversed order of indices, NULL if not needed */
+	COMPLEX *tw;           /* Twiddle factors e^(-2*pi*i*k/n), k < n/2 (k < n for mixed radix) */
+	int *factors;          /* Mixed radix kernel: radices of all stages */
+	COMPLEX *chirp;        /* Bluestein kernel: e^(-pi*i*k^2/n), k < n */
+	C_ARRAY *bspec;        /* Bluestein kernel: spectrum of conjugated chirp */
+	int n1, n2;            /* Four-step kernel: n = n1*n2, sizes of the row transforms */
+	struct fft_plan *sub1; /* Four-step kernel: plans for rows of length n1 and n2, */
+	struct fft_plan *sub2; /*  Bluestein kernel: sub1 is cached plan of the convolution */
+	struct fft_plan *next; /* Next plan in the cache */
+};
+
+
+extern enum plan_mode plan_mode;
+extern int forced_kernel;
+extern int fft_threads;
+
+extern const char *kernelName(enum fft_kernel kernel);
+extern int kernelByName(const char *name);
+extern struct fft_plan *makePlan(int n, enum fft_kernel kernel);
+extern void freePlan(struct fft_plan *plan);
+extern C_ARRAY *runPlan(struct fft_plan *plan, C_ARRAY *ca);
+
+extern struct fft_plan *getPlan(int n);
+extern C_ARRAY *transform(C_ARRAY *ca);
+extern void freePlans(void);
+extern void parallelFor(int count, void (*body)(void *, int, int), void *ctx);
+
+extern int loadWisdom(char *fpath);
+extern int saveWisdom(char *fpath);
+extern int newWisdom(void);
+
+#endif
@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  fir.c
+ *
+ *    Description:  FIR filter engine. Response of all virtual knobs is
+ *                  turned into finite impulse response of chosen length,
+ *                  either with linear, or with minimum phase. Filter is
+ *                  then applied on the whole sound track by overlap-save
+ *                  convolution, so there is no wrap around at the edges
+ *                  of the windows. For low latency, filter can be split
+ *                  into partitions of few samples, which are convolved
+ *                  with short blocks of the input.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "fir.h"
+#include "knobs.h"
+#include "equalizer.h"
+#include "complex.h"
+#include "my_std.h"
+
+/* Largest block length considered for overlap-save convolution */
+#define OS_MAX_BLOCK (1 << 20)
+/* Lowest gain used in logarithm of the minimum phase design */
+#define MIN_GAIN 1e-12
+
+
+/*
+ *  Designs linear phase FIR with odd number of "taps" from the response
+ *   curve "gains" counted for spectrum of "grid" bins. Desired response
+ *   is transformed to the time domain, centered and windowed by Hamming
+ *   window function.
+ */
+static C_ARRAY *linearFIR(double *gains, int grid, int taps) {
+	C_ARRAY *resp = allocCA(grid);
+	resp->len = grid;
+
+	/* Real and symmetric spectrum gives real and zero phase impulse */
+	int i;
+	for (i=0; i <= grid/2; i++) {
+		resp->c[i].re = gains[i];
+		resp->c[(grid - i) % grid].re = gains[i];
+	}
+	C_ARRAY *imp = idft(resp);
+
+	/* Shift the impulse, so that its center is in the middle of the filter */
+	C_ARRAY *fir = allocCA(taps);
+	fir->len = taps;
+	int delay = (taps - 1)/2;
+	for (i=0; i<taps; i++) {
+		fir->c[i].re = imp->c[(i - delay + grid) % grid].re;
+	}
+	hammingWindow(fir, 0.54, 0.46);
+
+	freeCA(resp); freeCA(imp);
+
+	return fir;
+}
+
+/*
+ *  Designs minimum phase FIR of length "taps" from the response curve
+ *   "gains" counted for spectrum of "grid" bins. Minimum phase is
+ *   obtained by folding the real cepstrum of the magnitude response,
+ *   the tail of the impulse is faded out by the second half of
+ *   Hamming window function.
+ */
+static C_ARRAY *minimumFIR(double *gains, int grid, int taps) {
+	C_ARRAY *logm = allocCA(grid);
+	logm->len = grid;
+
+	int i;
+	for (i=0; i <= grid/2; i++) {
+		double lg = log(MAX(gains[i], MIN_GAIN));
+		logm->c[i].re = lg;
+		logm->c[(grid - i) % grid].re = lg;
+	}
+	C_ARRAY *cep = idft(logm);
+
+	/* Fold the cepstrum, anti-causal part is moved to the causal one */
+	C_ARRAY *fold = allocCA(grid);
+	fold->len = grid;
+	fold->c[0].re = cep->c[0].re;
+	for (i=1; i < grid/2; i++) {
+		fold->c[i].re = 2.0*cep->c[i].re;
+	}
+	fold->c[grid/2].re = cep->c[grid/2].re;
+
+	/* Exponential of the folded cepstrum is the minimum phase response */
+	C_ARRAY *spec = dft(fold);
+	for (i=0; i<grid; i++) {
+		COMPLEX nc = polarToComplex(exp(spec->c[i].re), spec->c[i].im);
+		setCA(spec, i, nc.re, nc.im);
+	}
+	C_ARRAY *imp = idft(spec);
+
+	C_ARRAY *fir = allocCA(taps);
+	fir->len = taps;
+	for (i=0; i<taps; i++) {
+		fir->c[i].re = imp->c[i].re * (0.54 + 0.46*cos((M_PI*i)/taps));
+	}
+
+	freeCA(logm); freeCA(cep); freeCA(fold);
+	freeCA(spec); freeCA(imp);
+
+	return fir;
+}
+
+/*
+ *  Turns combined response of all modifications in the list into FIR
+ *   filter with "taps" coefficients (stored in real parts of the result).
+ *   Linear phase filters have always odd length, so "taps" is rounded
+ *   up in that case.
+ */
+C_ARRAY *designFIR(struct b_modif *head, struct octave *oct, int srate, int taps, int min_phase) {
+	int grid;
+	C_ARRAY *fir;
+
+	if (min_phase) {
+		/* Cepstrum needs dense grid, otherwise it aliases */
+		grid = get_pow(MAX(16*taps, 8192), 2);
+	} else {
+		taps |= 1;
+		grid = get_pow(MAX(8*taps, 4096), 2);
+	}
+	log_out(45, "Designing %s phase FIR with %d taps on grid of %d bins\n", (min_phase) ? "minimum" : "linear", taps, grid);
+
+	double *gains = compileGains(head, oct, grid, srate);
+	if (min_phase) {
+		fir = minimumFIR(gains, grid, taps);
+	} else {
+		fir = linearFIR(gains, grid, taps);
+	}
+	free(gains);
+
+	return fir;
+}
+
+/*
+ *  Designs linear phase low-pass filter with odd number of "taps" and
+ *   "cutoff" frequency (in Hz) as Hamming windowed sinc function.
+ */
+C_ARRAY *lowpassFIR(double cutoff, int srate, int taps) {
+	taps |= 1;
+	C_ARRAY *lp = allocCA(taps);
+	lp->len = taps;
+	double fc = 2.0*cutoff/srate;
+	int mid = (taps - 1)/2;
+
+	int i;
+	for (i=0; i<taps; i++) {
+		double t = fc*(i - mid);
+		lp->c[i].re = (t == 0) ? fc : fc*sin(M_PI*t)/(M_PI*t);
+	}
+	hammingWindow(lp, 0.54, 0.46);
+
+	return lp;
+}
+
+/*
+ *  Returns delay of given filter in number of samples.
+ */
+int firDelay(C_ARRAY *fir, int min_phase) {
+	return (min_phase) ? 0 : (fir->len - 1)/2;
+}
+
+/*
+ *  Returns length of FFT block for overlap-save convolution with filter
+ *   of "taps" coefficients. Chosen is the power of 2 with the lowest
+ *   estimated cost of the transforms per one output sample.
+ */
+int osBlockLen(int taps) {
+	int best = get_pow(2*taps, 2);
+	double best_cost = -1;
+	int len;
+	for (len=best; len <= OS_MAX_BLOCK; len *= 2) {
+		double cost = (len * log2(len))/(len - taps + 1);
+		if (best_cost < 0 || cost < best_cost) {
+			best_cost = cost;
+			best = len;
+		}
+	}
+
+	return best;
+}
+
+/*
+ *  Applies filter "fir" on the input track by overlap-save convolution.
+ *   Output is moved by "delay" samples to the past, so that delay of
+ *   linear phase filters is compensated. Returns new array with the
+ *   same length as the input one.
+ */
+C_ARRAY *convolveOS(C_ARRAY *in, C_ARRAY *fir, int delay) {
+	int taps = fir->len;
+	int blen = osBlockLen(taps);
+	int step = blen - taps + 1;
+
+	log_out(45, "Overlap-save convolution with block of %d samples, step %d\n", blen, step);
+
+	/* Spectrum of the filter is the same for all blocks */
+	C_ARRAY *fpad = allocCA(blen);
+	copyCA(fir, 0, fpad, 0, taps);
+	fpad->len = blen;
+	C_ARRAY *fspec = dft(fpad);
+	freeCA(fpad);
+
+	C_ARRAY *out = allocCA(in->len);
+	out->len = in->len;
+	C_ARRAY *blk = allocCA(blen);
+
+	int pos;
+	for (pos=0; pos < in->len; pos += step) {
+		/* Block has to contain also "taps-1" older samples */
+		int st = pos + delay - (taps - 1);
+		int i;
+		for (i=0; i<blen; i++) {
+			if (st + i >= 0 && st + i < in->len) {
+				blk->c[i] = in->c[st + i];
+			} else {
+				setCA(blk, i, 0.0, 0.0);
+			}
+		}
+		blk->len = blen;
+
+		C_ARRAY *bspec = dft(blk);
+		for (i=0; i<blen; i++) {
+			bspec->c[i] = complexMult(bspec->c[i], fspec->c[i]);
+		}
+		C_ARRAY *res = idft(bspec);
+
+		/* First "taps-1" samples are wrapped around, throw them away */
+		for (i=0; i < step && pos + i < in->len; i++) {
+			out->c[pos + i].re = res->c[taps - 1 + i].re;
+		}
+
+		freeCA(bspec); freeCA(res);
+	}
+
+	freeCA(blk); freeCA(fspec);
+
+	return out;
+}
+
+/*
+ *  Applies filter "fir" on the input track by uniformly partitioned
+ *   convolution, latency is only "block" samples (power of 2). Filter
+ *   is split into partitions of "block" coefficients, spectra of the
+ *   last input blocks are kept in frequency delay line and every output
+ *   block is sum of their products with spectra of the partitions.
+ *   Transforms have only 2*"block" samples, so small ones are done by
+ *   codelets. Output is moved by "delay" samples to the past like in
+ *   convolveOS, result has the same length as the input.
+ */
+C_ARRAY *convolvePartitioned(C_ARRAY *in, C_ARRAY *fir, int delay, int block) {
+	int taps = fir->len;
+	int parts = (taps + block - 1)/block;
+	int flen = 2*block;
+	C_ARRAY **hspec; /* Spectra of the partitions of the filter */
+	C_ARRAY **fdl;   /* Frequency delay line, spectra of the last input blocks */
+
+	log_out(45, "Partitioned convolution with %d partitions of %d samples\n", parts, block);
+
+	if ((hspec = (C_ARRAY **) malloc(parts * sizeof(C_ARRAY *))) == NULL ||
+	    (fdl = (C_ARRAY **) malloc(parts * sizeof(C_ARRAY *))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	int p, i;
+	for (p=0; p<parts; p++) {
+		C_ARRAY *seg = allocCA(flen);
+		copyCA(fir, p*block, seg, 0, MIN(block, taps - p*block));
+		seg->len = flen;
+		hspec[p] = dft(seg);
+		freeCA(seg);
+		fdl[p] = allocCA(flen);
+		fdl[p]->len = flen;
+	}
+
+	C_ARRAY *out = allocCA(in->len);
+	out->len = in->len;
+	C_ARRAY *win = allocCA(flen);  /* Previous and current input block */
+	win->len = flen;
+	C_ARRAY *acc = allocCA(flen);  /* Sum of the products of spectra */
+	acc->len = flen;
+
+	int pos, cur = 0;
+	for (pos=0; pos < in->len + delay; pos += block) {
+		/* Move the current block to the first half, read new one */
+		for (i=0; i<block; i++) {
+			win->c[i] = win->c[block + i];
+			if (pos + i < in->len) {
+				win->c[block + i] = in->c[pos + i];
+			} else {
+				setCA(win, block + i, 0.0, 0.0);
+			}
+		}
+		freeCA(fdl[cur]);
+		fdl[cur] = dft(win);
+
+		/* Newest input block meets the first partition, and so on */
+		for (i=0; i<flen; i++) {
+			setCA(acc, i, 0.0, 0.0);
+		}
+		for (p=0; p<parts; p++) {
+			C_ARRAY *x = fdl[(cur - p + parts) % parts];
+			for (i=0; i<flen; i++) {
+				acc->c[i] = complexAdd(acc->c[i], complexMult(x->c[i], hspec[p]->c[i]));
+			}
+		}
+		C_ARRAY *res = idft(acc);
+
+		/* The first half is wrapped around, the second one is output */
+		for (i=0; i<block; i++) {
+			int o = pos + i - delay;
+			if (o >= 0 && o < in->len) {
+				out->c[o].re = res->c[block + i].re;
+			}
+		}
+		freeCA(res);
+		cur = (cur + 1) % parts;
+	}
+
+	for (p=0; p<parts; p++) {
+		freeCA(hspec[p]); freeCA(fdl[p]);
+	}
+	free(hspec); free(fdl);
+	freeCA(win); freeCA(acc);
+
+	return out;
+}
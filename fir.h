@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  fir.h
+ *
+ *    Description:  FIR filter engine. Response of all virtual knobs is
+ *                  turned into finite impulse response of chosen length,
+ *                  either with linear, or with minimum phase. Filter is
+ *                  then applied on the whole sound track by overlap-save
+ *                  convolution, so there is no wrap around at the edges
+ *                  of the windows. For low latency, filter can be split
+ *                  into partitions of few samples, which are convolved
+ *                  with short blocks of the input.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef FIR_H_
+#define FIR_H_
+
+#include "complex.h"
+#include "equalizer.h"
+#include "knobs.h"
+
+
+extern C_ARRAY *designFIR(struct b_modif *head, struct octave *oct, int srate, int taps, int min_phase);
+extern C_ARRAY *lowpassFIR(double cutoff, int srate, int taps);
+extern int firDelay(C_ARRAY *fir, int min_phase);
+
+extern int osBlockLen(int taps);
+extern C_ARRAY *convolveOS(C_ARRAY *in, C_ARRAY *fir, int delay);
+extern C_ARRAY *convolvePartitioned(C_ARRAY *in, C_ARRAY *fir, int delay, int block);
+
+#endif
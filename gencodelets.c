@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  gencodelets.c
+ *
+ *    Description:  Generator of FFT codelets. For every size from 2 to 64,
+ *                  it prints out C function computing the transform of that
+ *                  size as straight-line code without loops, recursion or
+ *                  allocations, twiddle factors are written as constants.
+ *                  Code is derived from radix-2 decimation in time, every
+ *                  complex value gets its own local variable and the
+ *                  multiplications by 1 and -i are left out.
+ *
+ *                  It is run by make, output is stored in codelets.c:
+ *                  ./gencodelets > codelets.c
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* The biggest generated codelet is of size 2^MAX_LOG */
+#define MAX_LOG 6
+#define MAX_N (1 << MAX_LOG)
+
+
+/* Number of the next local variable */
+static int var = 0;
+
+
+/*
+ *  Prints out code of transform of "n" inputs with indices "in", numbers
+ *   of variables holding the results are stored into "out".
+ */
+static void genFFT(int n, int *in, int *out) {
+	if (n == 1) {
+		printf("\tdouble r%d = in[%d*is].re, i%d = in[%d*is].im;\n", var, in[0], var, in[0]);
+		out[0] = var++;
+		return;
+	}
+
+	int even_in[MAX_N/2], odd_in[MAX_N/2];
+	int even[MAX_N/2], odd[MAX_N/2];
+	int k;
+	for (k=0; k < n/2; k++) {
+		even_in[k] = in[2*k];
+		odd_in[k] = in[2*k + 1];
+	}
+	genFFT(n/2, even_in, even);
+	genFFT(n/2, odd_in, odd);
+
+	for (k=0; k < n/2; k++) {
+		int o = odd[k];
+		int t;
+		/* Multiply by twiddle factor e^(-2*pi*i*k/n) */
+		if (k == 0) {
+			t = o;
+		} else if (4*k == n) {
+			t = var++;
+			printf("\tdouble r%d = i%d, i%d = -r%d;\n", t, o, t, o);
+		} else {
+			double c = cos(2*M_PI*k/n);
+			double s = -sin(2*M_PI*k/n);
+			t = var++;
+			printf("\tdouble r%d = %.17g*r%d - %.17g*i%d, i%d = %.17g*i%d + %.17g*r%d;\n",
+				t, c, o, s, o, t, c, o, s, o);
+		}
+		int a = var++;
+		int b = var++;
+		printf("\tdouble r%d = r%d + r%d, i%d = i%d + i%d;\n", a, even[k], t, a, even[k], t);
+		printf("\tdouble r%d = r%d - r%d, i%d = i%d - i%d;\n", b, even[k], t, b, even[k], t);
+		out[k] = a;
+		out[k + n/2] = b;
+	}
+}
+
+/*
+ *  Prints out all codelets and table of them.
+ */
+int main(void) {
+	int in[MAX_N], out[MAX_N];
+	int lg, k;
+
+	printf("/*\n * Generated by gencodelets, do not edit.\n */\n\n");
+	printf("#include \"codelets.h\"\n#include \"complex.h\"\n\n");
+
+	for (lg=1; lg <= MAX_LOG; lg++) {
+		int n = 1 << lg;
+		var = 0;
+		printf("/*\n *  Transform of %d elements of \"in\" with stride \"is\" into \"out\".\n */\n", n);
+		printf("static void codelet%d(const COMPLEX *in, int is, COMPLEX *out) {\n", n);
+		for (k=0; k<n; k++) {
+			in[k] = k;
+		}
+		genFFT(n, in, out);
+		for (k=0; k<n; k++) {
+			printf("\tout[%d].re = r%d; out[%d].im = i%d;\n", k, out[k], k, out[k]);
+		}
+		printf("}\n\n");
+	}
+
+	/* Transform of one element is just a copy */
+	printf("static void codelet1(const COMPLEX *in, int is, COMPLEX *out) {\n\tout[0] = in[0];\n}\n\n");
+	printf("codelet_f codelets[CODELETS] = {\n\tcodelet1");
+	for (lg=1; lg <= MAX_LOG; lg++) {
+		printf(", codelet%d", 1 << lg);
+	}
+	printf("\n};\n");
+
+	return (0);
+}
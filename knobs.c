@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  knobs.c
+ *
+ *    Description:  This module handles configuration of virtual knobs.
+ *                  Knob settings given by the user are parsed into linked
+ *                  list of band modifications (structure b_modif), which
+ *                  can be either applied directly on the spectrum, or
+ *                  compiled into one response curve with gain for every
+ *                  frequency bin.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "knobs.h"
+#include "my_std.h"
+#include "equalizer.h"
+#include "complex.h"
+#include "string.h"
+
+/* Largest difference from 1.0 of gain, which does not change anything */
+#define IDENTITY_EPS 1e-9
+
+
+/*
+ *  GLOBAL VARIABLES
+ *  Windows with RMS bellow "silence_level" are not transformed, zero turns
+ *   this check off, they are only multiplied by "silence_gain" (broadband
+ *   gain of the knobs, equalizeWindows uses gain of its part of spectrum). Counters of all processed windows and of windows,
+ *   which were skipped, are shared by the whole run.
+ */
+double silence_level = 0.0;
+double silence_gain = 1.0;
+int windows_total = 0;
+int windows_skipped = 0;
+
+
+/*
+ *  Add new modification to the linked list structure b_modif.
+ *  Returns new head of the list, NULL if the modification is invalid.
+ */
+struct b_modif *addModif(struct b_modif *head, struct octave *oct, char func, int band_id, double gain) {
+	printf("New modifier: func=%c band_id=%d gain=%.2fdB\n", func, band_id, gain);
+	struct b_modif *nbm;
+	if ((nbm = (struct b_modif *) malloc(sizeof(struct b_modif))) == NULL) {
+		perror("malloc");
+		return NULL;
+	}
+
+	/* Check, if given band_id is really part of given Octave */
+	if (band_id < 1 || band_id > oct->len) {
+		fprintf(stderr, "Band ID is out of range [1; %d]\n", oct->len);
+		free(nbm);
+		return NULL;
+	}
+	nbm->band_id = band_id;
+	/* Check range of given gain, allowed are only values from range [-24; 24] */
+	if (gain < -24.0 || gain > 24.0) {
+		fprintf(stderr, "Gain is out of range [-24; 24]dB\n");
+		free(nbm);
+		return NULL;
+	}
+	nbm->gain = gain;
+	nbm->next = head;
+
+	/* Decide which function will be used to modificate this band */
+	switch (func) {
+		case 'p':
+			nbm->modif_f = peakBand;
+			break;
+		case 'f':
+			nbm->modif_f = flatBand;
+			break;
+		case 'n':
+			nbm->modif_f = nextBand;
+			break;
+		default:
+			fprintf(stderr, "Unknown modification function\n");
+			free(nbm);
+			return NULL;
+	}
+
+	return nbm;
+}
+
+/*
+ *  Parse option inputs and appropriately initialize b_modif as a linked list
+ *   of these modifications, new elements are added to the list "*head".
+ *   Returns 0 on success, -1 if the configuration is not valid.
+ *
+ *  We assume the input is in correct format, therefore only the last two parameters
+ *   are being checked, bad function is recognized when we are adding new
+ *   modification to the linked list.
+ *
+ *  Element of the string "bands_in" should have following format:
+ *   [band_start(number)][-band_end(number)][function(char)][sign(char)][gain(number)]
+ *   where "band_end" and "sing" are not required, elements should be separated by comma.
+ */
+int initModifs(struct b_modif **head, struct octave *oct, char *bands_in) {
+	int  i=0;     /* Defines position in bands_in string */
+	char akt;     /* Currently proccesed character */
+	int  band_id1;/* First band ID value, that was readed from current element */
+	int  band_id2;/* Specifies the second range margin of bands that will be modified */
+	char func;    /* Function defining character, readed from current element */
+	int  gain;    /* Gain value from current element */
+	STRING token = alloc_string(20);
+	while ((akt = bands_in[i++]) != '\0' && i < strlen(bands_in)) {
+		/* First we read band_id, which is integer */
+		init_string(&token, 20, 0);
+		while (akt >= '0' && akt <= '9') {
+			append(&token, akt);
+			akt = bands_in[i++];
+		}
+		band_id1 = atoi(token.text);
+		band_id2 = band_id1;
+
+		/* Read the second range margin if exists */
+		if (akt == '-') {
+			init_string(&token, 20, 0);
+			akt = bands_in[i++];
+			while (akt >= '0' && akt <= '9') {
+				append(&token, akt);
+				akt = bands_in[i++];
+			}
+			band_id2 = atoi(token.text);
+		}
+
+		/* Now read character defining the function to be used */
+		func = akt;
+		akt = bands_in[i++];
+
+		/*
+		 * Now read the gain (integer number with sign + or -)
+		 * No sign is also correct, its meaning is + sign.
+		 */
+		init_string(&token, 20, 0);
+		if (akt == '+' || akt == '-' || (akt >= '0' && akt <= '9')) {
+			append(&token, akt);
+			akt = bands_in[i++];
+		} else {
+			/* The only thing we check for (might be unclear for users) */
+			fprintf(stderr, "Incorrect sign before gain number\n");
+			free_string(&token);
+			return -1;
+		}
+		/* Read the rest of the gain number (if exists) */
+		while (akt >= '0' && akt <= '9') {
+			append(&token, akt);
+			akt = bands_in[i++];
+		}
+		gain = atoi(token.text);
+
+		/*
+		 * Go through the whole range of given bands IDs and add
+		 * each of them as a new modification to the linked list.
+		 */
+		int j;
+		for (j=band_id1; j <= band_id2; j++) {
+			struct b_modif *nhead = addModif(*head, oct, func, j, gain);
+			if (nhead == NULL) {
+				free_string(&token);
+				return -1;
+			}
+			*head = nhead;
+		}
+	}
+	free_string(&token);
+
+	return 0;
+}
+
+/*
+ *  Execute all of the modifications in the b_modif linked list on "ca" array.
+ */
+void processModifs(struct b_modif *head, C_ARRAY *ca, struct octave *oct, int srate) {
+	struct b_modif *actb;
+	actb = head;
+	/* Go through the linked list and apply each modification */
+	while (actb != NULL) {
+		struct band *bnd = getBand(oct, actb->band_id);
+		log_out(71, "Processing modification of %d. band with gain %.2f\n", actb->band_id, actb->gain);
+		actb->modif_f(ca, bnd, srate, actb->gain);
+		actb = actb->next;
+	}
+	log_out(71, "\n");
+}
+
+/*
+ *  Free allocated space on heap by b_modif structure
+ */
+void freeModifs(struct b_modif *head) {
+	struct b_modif *prev, *pom;
+	pom = head;
+	while (pom != NULL) {
+		prev = pom;
+		pom = pom->next;
+		free(prev);
+	}
+}
+
+/*
+ *  Allocates new preset "name" without any knobs.
+ */
+static struct preset *newPreset(char *name) {
+	struct preset *np;
+	if ((np = (struct preset *) malloc(sizeof(struct preset))) == NULL ||
+	    (np->name = strdup(name)) == NULL) {
+		perror("malloc");
+		return NULL;
+	}
+	np->modifs = NULL;
+	np->stem = 0;
+	np->bands = NULL;
+	np->gains = NULL;
+	np->broadband = 1.0;
+	np->next = NULL;
+
+	return np;
+}
+
+/*
+ *  Adds preset "np" to the end of the list, returns head of the list.
+ */
+static struct preset *appendPreset(struct preset *head, struct preset *np) {
+	if (head == NULL) {
+		return np;
+	}
+	struct preset *last = head;
+	while (last->next != NULL) {
+		last = last->next;
+	}
+	last->next = np;
+
+	return head;
+}
+
+/*
+ *  Adds new preset "name" with knobs "bands_in" (in format of initModifs)
+ *   to the end of the list. Returns head of the list, NULL if the knobs
+ *   are not valid.
+ */
+struct preset *addPreset(struct preset *head, struct octave *oct, char *name, char *bands_in) {
+	struct preset *np;
+	if ((np = newPreset(name)) == NULL) {
+		return NULL;
+	}
+	if (initModifs(&np->modifs, oct, bands_in) != 0) {
+		freePresets(np);
+		return NULL;
+	}
+
+	return appendPreset(head, np);
+}
+
+/*
+ *  Adds stems defined by "groups_in" to the end of the list, and one more
+ *   stem "rest" with everything, what is not in any group. Groups are
+ *   separated by commas, every group has name, character ':' and band
+ *   ranges separated by '+', e.g. "low:1-4,mid:5-7+9". Returns head of
+ *   the list, NULL if the groups are not valid.
+ */
+struct preset *addStems(struct preset *head, struct octave *oct, char *groups_in) {
+	char *groups, *grp, *rng, *gsave, *rsave;
+	if ((groups = strdup(groups_in)) == NULL) {
+		perror("malloc");
+		return NULL;
+	}
+
+	for (grp = strtok_r(groups, ",", &gsave); grp != NULL; grp = strtok_r(NULL, ",", &gsave)) {
+		char *colon = strchr(grp, ':');
+		if (colon == NULL || colon == grp) {
+			fprintf(stderr, "Stem \"%s\" has no name\n", grp);
+			free(groups);
+			return NULL;
+		}
+		*colon = '\0';
+		struct preset *np;
+		if ((np = newPreset(grp)) == NULL) {
+			free(groups);
+			return NULL;
+		}
+		np->stem = 1;
+		np->bands = (char *) calloc(oct->len + 1, sizeof(char));
+
+		/* Band ranges of the group, every one is "id" or "id-id" */
+		for (rng = strtok_r(colon + 1, "+", &rsave); rng != NULL; rng = strtok_r(NULL, "+", &rsave)) {
+			int first, last, used = 0;
+			if (sscanf(rng, "%d%n-%d%n", &first, &used, &last, &used) == 1) {
+				last = first;
+			}
+			if (used != (int) strlen(rng) || first < 1 || last < first || last > oct->len) {
+				fprintf(stderr, "Invalid bands \"%s\" of stem \"%s\", range is [1; %d]\n", rng, grp, oct->len);
+				freePresets(np);
+				free(groups);
+				return NULL;
+			}
+			for (; first <= last; first++) {
+				np->bands[first] = 1;
+			}
+		}
+		head = appendPreset(head, np);
+	}
+	free(groups);
+
+	/* Rest has no bands, it gets all bins, which no group took */
+	struct preset *rest;
+	if ((rest = newPreset("rest")) == NULL) {
+		return NULL;
+	}
+	rest->stem = 1;
+
+	return appendPreset(head, rest);
+}
+
+/*
+ *  Reads presets from file "fpath" and adds them to the end of the list.
+ *   Every line contains name of the preset and its knobs separated by
+ *   white-space, empty lines and lines starting with '#' are skipped.
+ *   Returns number of read presets, -1 on error (the list is not changed
+ *   by the invalid line).
+ */
+int loadPresets(struct preset **head, struct octave *oct, char *fpath) {
+	FILE *fin;
+	if ((fin = fopen(fpath, "r")) == NULL) {
+		perror("fopen");
+		return -1;
+	}
+
+	char line[1024], name[64], knobs[960];
+	int lnum = 0, count = 0;
+	struct preset *np;
+	while (fgets(line, sizeof(line), fin) != NULL) {
+		lnum++;
+		if (line[0] == '#' || sscanf(line, "%63s", name) != 1) {
+			continue;
+		}
+		if (sscanf(line, "%63s %959s", name, knobs) != 2) {
+			fprintf(stderr, "Preset \"%s\" on line %d of \"%s\" has no knobs\n", name, lnum, fpath);
+			fclose(fin);
+			return -1;
+		}
+		if ((np = addPreset(NULL, oct, name, knobs)) == NULL) {
+			fprintf(stderr, "Invalid knobs of preset \"%s\" on line %d of \"%s\"\n", name, lnum, fpath);
+			fclose(fin);
+			return -1;
+		}
+		*head = appendPreset(*head, np);
+		count++;
+	}
+	fclose(fin);
+
+	return count;
+}
+
+/*
+ *  Reads knobs from file "fpath" into buffer "knobs" of "size" bytes.
+ *   Every line which is not empty and does not start with '#' is list
+ *   of knobs in format of option "-k", lines are joined. Returns 0 on
+ *   success, -1 if the file cannot be read or the knobs are too long.
+ */
+int readKnobs(char *fpath, char *knobs, int size) {
+	FILE *fin;
+	if ((fin = fopen(fpath, "r")) == NULL) {
+		perror("fopen");
+		return -1;
+	}
+	char line[1024];
+	knobs[0] = '\0';
+	while (fgets(line, sizeof(line), fin) != NULL) {
+		line[strcspn(line, " \t\r\n")] = '\0';
+		if (line[0] == '#' || line[0] == '\0') {
+			continue;
+		}
+		if (strlen(knobs) + strlen(line) + 2 > size) {
+			fprintf(stderr, "Knobs in \"%s\" are too long\n", fpath);
+			fclose(fin);
+			return -1;
+		}
+		if (knobs[0] != '\0') {
+			strcat(knobs, ",");
+		}
+		strcat(knobs, line);
+	}
+	fclose(fin);
+
+	return 0;
+}
+
+/*
+ *  Releases the whole list of presets.
+ */
+void freePresets(struct preset *head) {
+	struct preset *prev;
+	while (head != NULL) {
+		prev = head;
+		head = head->next;
+		freeModifs(prev->modifs);
+		free(prev->bands);
+		free(prev->gains);
+		free(prev->name);
+		free(prev);
+	}
+}
+
+/*
+ *  Compiles all modifications from the list into one response curve
+ *   for spectrum of "len" bins in sample rate "srate". Returned array
+ *   has len/2 + 1 elements (up to the Nyquist frequency), each of them
+ *   is multiplier, which the modifications apply on given bin.
+ */
+double *compileGains(struct b_modif *head, struct octave *oct, int len, int srate) {
+	double *gains = allocDoubles(len/2 + 1);
+	C_ARRAY *probe = allocCA(len);
+
+	/*
+	 * Both parts of the probe are set to one, so that the modification
+	 * functions are not skipping any of the bins.
+	 */
+	int i;
+	for (i=0; i<len; i++) {
+		setCA(probe, i, 1.0, 1.0);
+	}
+	probe->len = len;
+
+	processModifs(head, probe, oct, srate);
+	for (i=0; i <= len/2; i++) {
+		gains[i] = probe->c[i].re;
+	}
+	freeCA(probe);
+
+	return gains;
+}
+
+/*
+ *  Returns 1 if compiled response "gains" for spectrum of "len" bins
+ *   does not change any bin, 0 otherwise.
+ */
+int isIdentity(double *gains, int len) {
+	int i;
+	for (i=0; i <= len/2; i++) {
+		if (fabs(gains[i] - 1.0) > IDENTITY_EPS) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ *  Returns the highest multiplier from compiled response "gains"
+ *   for spectrum of "len" bins.
+ */
+double maxGain(double *gains, int len) {
+	double mx = 0.0;
+	int i;
+	for (i=0; i <= len/2; i++) {
+		mx = MAX(mx, gains[i]);
+	}
+
+	return mx;
+}
+
+/*
+ *  Returns gain of response "gains" for spectrum of "len" bins on white
+ *   noise between bins "from" and "to" (both included).
+ */
+double bandGain(double *gains, int len, int from, int to) {
+	from = MAX(from, 0);
+	to = MIN(to, len/2);
+	if (to < from) {
+		return 1.0;
+	}
+
+	double sum = 0.0;
+	int i;
+	for (i=from; i <= to; i++) {
+		sum += gains[i]*gains[i];
+	}
+
+	return sqrt(sum/(to - from + 1));
+}
+
+/*
+ *  Returns broadband gain of response "gains" for spectrum of "len" bins,
+ *   i.e. gain of white noise. Silent windows are multiplied by it, so that
+ *   they follow the cut of the knobs without their spectrum.
+ */
+double broadbandGain(double *gains, int len) {
+	return bandGain(gains, len, 0, len/2);
+}
+
+/*
+ *  Returns RMS level, bellow which windows are not transformed, for
+ *   silence level "s_value" in dBFS and the highest gain "max_gain" of the
+ *   knobs. Window stays bellow "s_value" after boosting knobs, but cutting
+ *   knobs must not raise the level, otherwise loud windows would escape
+ *   the cut.
+ */
+double silenceLevel(double s_value, double max_gain) {
+	return pow(10.0, s_value/20.0)/MAX(max_gain, 1.0);
+}
+
+/*
+ *  Multiplies spectrum "ca" by response "gains" compiled by compileGains
+ *   for the same length. Bins with real value are skipped, modification
+ *   functions do not change them either (see gainToComplex), so the
+ *   result is the same as by processModifs.
+ */
+void applyGains(double *gains, C_ARRAY *ca) {
+	int i;
+	for (i=0; i <= ca->len/2; i++) {
+		if (ca->c[i].im != 0 || ca->c[i].re == 0) {
+			ca->c[i].re *= gains[i];
+			ca->c[i].im *= gains[i];
+		}
+	}
+}
+
+/*
+ *  Compiles masks of all stems in the list for spectrum of "len" bins in
+ *   sample rate "srate". Every bin belongs to exactly one stem, to the
+ *   first one with a band containing it, or to the stem without bands
+ *   (rest), so the stems sum back to the input. Inverse transform counts
+ *   DC twice, it has no mirror bin, so it is halved in the mask.
+ */
+void compileStems(struct preset *head, struct octave *oct, int len, int srate) {
+	struct preset *st, *rest = NULL;
+	for (st=head; st != NULL; st=st->next) {
+		st->gains = allocDoubles(len/2 + 1);
+		if (st->bands == NULL) {
+			rest = st;
+		}
+	}
+
+	int i;
+	for (i=0; i <= len/2; i++) {
+		struct preset *owner = rest;
+		struct band *b;
+		int band_id;
+		for (b=oct->head, band_id=1; b != NULL && owner == rest; b=b->next, band_id++) {
+			if (i < freqToIndex(b->lowerE, len, srate) || i >= freqToIndex(b->upperE, len, srate)) {
+				continue;
+			}
+			for (st=head; st != NULL; st=st->next) {
+				if (st->bands != NULL && st->bands[band_id]) {
+					owner = st;
+					break;
+				}
+			}
+		}
+		owner->gains[i] = (i == 0) ? 0.5 : 1.0;
+	}
+}
+
+/*
+ *  Multiplies all bins of spectrum "ca" by mask "mask" compiled by
+ *   compileStems for the same length.
+ */
+void applyMask(double *mask, C_ARRAY *ca) {
+	int i;
+	for (i=0; i <= ca->len/2; i++) {
+		ca->c[i].re *= mask[i];
+		ca->c[i].im *= mask[i];
+	}
+}
+
+/*
+ *  Returns 1 if "len" samples of "ca" starting at "st" have RMS value
+ *   bellow "level", 0 otherwise.
+ */
+int belowLevel(C_ARRAY *ca, int st, int len, double level) {
+	if (level <= 0.0 || len <= 0) {
+		return 0;
+	}
+
+	double energy = 0.0;
+	int i;
+	for (i=st; i < st+len; i++) {
+		energy += ca->c[i].re * ca->c[i].re;
+	}
+
+	return energy < level*level*len;
+}
+
+/*
+ *  Writes "cnt" samples of silent window of "in" from "st" into "out" from
+ *   "ost" multiplied by "gain". Like copyCA, it adds them to the length
+ *   of "out".
+ */
+void copySilent(C_ARRAY *in, int st, C_ARRAY *out, int ost, int cnt, double gain) {
+	int i;
+	for (i=0; i<cnt; i++) {
+		setCA(out, ost + i, in->c[st + i].re*gain, in->c[st + i].im*gain);
+	}
+	out->len += cnt;
+}
+
+/*
+ *  Returns 1 if "len" samples of "ca" starting at "st" have RMS value
+ *   bellow the global "silence_level", 0 otherwise.
+ */
+int isSilent(C_ARRAY *ca, int st, int len) {
+	return belowLevel(ca, st, len, silence_level);
+}
+
+/*
+ *  Applies all modifications from the list on input track "in" window by
+ *   window, every window of "wlen" samples is transformed by FFT, modified
+ *   and transformed back. Last window is padded by zeros. Track carries
+ *   only frequencies from "lower" to "upper" (in Hz), silent windows are
+ *   multiplied by gain of the knobs there. Result is stored in "out",
+ *   which has to be allocated for at least "in->len" samples.
+ */
+void equalizeWindows(C_ARRAY *in, C_ARRAY *out, struct b_modif *head, struct octave *oct, int srate, int wlen, double lower, double upper) {
+	C_ARRAY *win = allocCA(wlen);
+	int win_num = (int) ceil((double) in->len/wlen);
+	int w_i;
+
+	double sgain = 1.0;
+	if (silence_level > 0.0) {
+		double *gains = compileGains(head, oct, wlen, srate);
+		sgain = bandGain(gains, wlen, freqToIndex((int) lower, wlen, srate), freqToIndex((int) upper, wlen, srate));
+		free(gains);
+	}
+
+	log_out(45, "Equalizing %d windows of %d samples in sample rate %dHz\n", win_num, wlen, srate);
+	for (w_i=0; w_i < win_num; w_i++) {
+		int wst = w_i*wlen;
+		int cnt = MIN(wlen, in->len - wst);
+		int i;
+
+		windows_total++;
+		if (isSilent(in, wst, cnt)) {
+			for (i=0; i<cnt; i++) {
+				out->c[wst + i].re = in->c[wst + i].re*sgain;
+			}
+			windows_skipped++;
+			continue;
+		}
+
+		initCA(win, wlen, 0);
+		copyCA(in, wst, win, 0, cnt);
+		win->len = wlen;
+
+		C_ARRAY *re = fft(win);
+		processModifs(head, re, oct, srate);
+		C_ARRAY *ire = ifft(re);
+
+		for (i=0; i<cnt; i++) {
+			out->c[wst + i].re = ire->c[i].re;
+		}
+		freeCA(ire); freeCA(re);
+	}
+	out->len = in->len;
+
+	freeCA(win);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  knobs.h
+ *
+ *    Description:  This module handles configuration of virtual knobs.
+ *                  Knob settings given by the user are parsed into linked
+ *                  list of band modifications (structure b_modif), which
+ *                  can be either applied directly on the spectrum, or
+ *                  compiled into one response curve with gain for every
+ *                  frequency bin.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef KNOBS_H_
+#define KNOBS_H_
+
+#include "complex.h"
+#include "equalizer.h"
+
+
+/*
+ *  Structure used to save all modification that will
+ *   be applied in linked list.
+ */
+struct b_modif {
+	/* C_ARRAY *sample, int srate, double gain [-24,+24] */
+	void (*modif_f)(C_ARRAY *, struct band *, int, double);
+	/* Which band will be modified */
+	int band_id;
+	/* What will be the gain passed into the modification function */
+	double gain;
+	/* Next operation in this linked list */
+	struct b_modif *next;
+};
+
+/*
+ *  Named set of knobs, more of them can be rendered from one analysis.
+ *   Stem has no knobs, it takes only bins of its bands from the spectrum.
+ */
+struct preset {
+	char *name;
+	struct b_modif *modifs;
+	int stem;               /* Gains are mask of stem, see compileStems */
+	char *bands;            /* Bands of stem (indexed by band ID), NULL for the rest */
+	double *gains;          /* Compiled response of the knobs, NULL until compiled */
+	double broadband;       /* Gain of silent windows, see broadbandGain */
+	struct preset *next;
+};
+
+
+extern double silence_level;
+extern double silence_gain;
+extern int windows_total;
+extern int windows_skipped;
+
+extern struct b_modif *addModif(struct b_modif *head, struct octave *oct, char func, int band_id, double gain);
+extern int initModifs(struct b_modif **head, struct octave *oct, char *bands_in);
+extern void processModifs(struct b_modif *head, C_ARRAY *ca, struct octave *oct, int srate);
+extern void freeModifs(struct b_modif *head);
+
+extern struct preset *addPreset(struct preset *head, struct octave *oct, char *name, char *bands_in);
+extern struct preset *addStems(struct preset *head, struct octave *oct, char *groups_in);
+extern int loadPresets(struct preset **head, struct octave *oct, char *fpath);
+extern void freePresets(struct preset *head);
+extern int readKnobs(char *fpath, char *knobs, int size);
+
+extern double *compileGains(struct b_modif *head, struct octave *oct, int len, int srate);
+extern int isIdentity(double *gains, int len);
+extern double maxGain(double *gains, int len);
+extern double bandGain(double *gains, int len, int from, int to);
+extern double broadbandGain(double *gains, int len);
+extern double silenceLevel(double s_value, double max_gain);
+extern void applyGains(double *gains, C_ARRAY *ca);
+extern void compileStems(struct preset *head, struct octave *oct, int len, int srate);
+extern void applyMask(double *mask, C_ARRAY *ca);
+extern int belowLevel(C_ARRAY *ca, int st, int len, double level);
+extern void copySilent(C_ARRAY *in, int st, C_ARRAY *out, int ost, int cnt, double gain);
+extern int isSilent(C_ARRAY *ca, int st, int len);
+extern void equalizeWindows(C_ARRAY *in, C_ARRAY *out, struct b_modif *head, struct octave *oct, int srate, int wlen, double lower, double upper);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  live.c
+ *
+ *    Description:  Live knobs. Watching thread reads knobs from a file
+ *                  whenever it changes, compiles their response curve and
+ *                  publishes it by atomic swap of one pointer. Processing
+ *                  thread only loads the pointer at the start of every
+ *                  window and reports finished windows, old curves are
+ *                  freed by the watching thread after the processing
+ *                  thread cannot use them anymore (RCU-like grace period).
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "live.h"
+#include "knobs.h"
+#include "my_std.h"
+
+/* How often the file is checked for changes (in ns) */
+#define LIVE_POLL 100000000
+/* How often the end of grace period is checked (in ns) */
+#define LIVE_GRACE 1000000
+/* Maximal length of all knobs in the file */
+#define LIVE_MAX_KNOBS 4096
+
+
+/*
+ *  Reads knobs from the watched file, if it was changed since the last
+ *   reading, format of the file is described by readKnobs. Returns
+ *   compiled response curve, NULL if the file was not changed or it is
+ *   not valid (then the old knobs are kept).
+ */
+static double *reloadKnobs(struct live_knobs *lk) {
+	struct stat st;
+	if (stat(lk->path, &st) != 0 ||
+	    (st.st_mtim.tv_sec == lk->mtime.tv_sec && st.st_mtim.tv_nsec == lk->mtime.tv_nsec && st.st_size == lk->size)) {
+		return NULL;
+	}
+	lk->mtime = st.st_mtim;
+	lk->size = st.st_size;
+
+	char knobs[LIVE_MAX_KNOBS];
+	if (readKnobs(lk->path, knobs, sizeof(knobs)) != 0) {
+		return NULL;
+	}
+
+	struct b_modif *modifs = NULL;
+	if (initModifs(&modifs, lk->oct, knobs) != 0) {
+		fprintf(stderr, "Invalid knobs in \"%s\", keeping the old ones\n", lk->path);
+		freeModifs(modifs);
+		return NULL;
+	}
+	double *gains = compileGains(modifs, lk->oct, lk->len, lk->srate);
+	freeModifs(modifs);
+
+	return gains;
+}
+
+/*
+ *  Body of the watching thread. New curve is published, and the old one
+ *   is freed, when the processing thread finished two more windows: it
+ *   could still use the old curve in the current window, and crossfade
+ *   from it in the next one.
+ */
+static void *watchLoop(void *arg) {
+	struct live_knobs *lk = (struct live_knobs *) arg;
+	struct timespec poll = {0, LIVE_POLL};
+	struct timespec grace = {0, LIVE_GRACE};
+
+	while (!__atomic_load_n(&lk->stopping, __ATOMIC_ACQUIRE)) {
+		nanosleep(&poll, NULL);
+		double *gains = reloadKnobs(lk);
+		if (gains == NULL) {
+			continue;
+		}
+		double *old = __atomic_exchange_n(&lk->cur, gains, __ATOMIC_ACQ_REL);
+		unsigned long epoch = __atomic_load_n(&lk->epoch, __ATOMIC_ACQUIRE);
+		__atomic_add_fetch(&lk->updates, 1, __ATOMIC_RELEASE);
+		printf("Knobs reloaded from \"%s\" after %lu windows\n", lk->path, epoch);
+
+		while (__atomic_load_n(&lk->epoch, __ATOMIC_ACQUIRE) < epoch + 2 &&
+		       !__atomic_load_n(&lk->stopping, __ATOMIC_ACQUIRE)) {
+			nanosleep(&grace, NULL);
+		}
+		free(old);
+	}
+
+	return NULL;
+}
+
+/*
+ *  Starts watching knobs in file "path" for spectrum of "len" bins in
+ *   sample rate "srate". Knobs in the file are read immediately, response
+ *   curve "gains" (which is then owned by the watcher) is used only if
+ *   the file cannot be read. Returns NULL on error.
+ */
+struct live_knobs *liveStart(char *path, struct octave *oct, int len, int srate, double *gains) {
+	struct live_knobs *lk;
+	if ((lk = (struct live_knobs *) calloc(1, sizeof(struct live_knobs))) == NULL ||
+	    (lk->path = strdup(path)) == NULL) {
+		perror("calloc");
+		free(lk);
+		return NULL;
+	}
+	lk->oct = oct;
+	lk->len = len;
+	lk->srate = srate;
+
+	lk->cur = reloadKnobs(lk);
+	if (lk->cur != NULL) {
+		free(gains);
+	} else {
+		printf("Knobs file \"%s\" cannot be used yet, starting with knobs of -k\n", path);
+		lk->cur = gains;
+	}
+
+	if (pthread_create(&lk->watcher, NULL, watchLoop, lk) != 0) {
+		perror("pthread_create");
+		free(lk->cur);
+		free(lk->path);
+		free(lk);
+		return NULL;
+	}
+
+	return lk;
+}
+
+/*
+ *  Returns the latest published curve, called by the processing thread
+ *   at the start of every window. It stays valid until the processing
+ *   thread calls liveQuiescent twice.
+ */
+double *liveAcquire(struct live_knobs *lk) {
+	return __atomic_load_n(&lk->cur, __ATOMIC_ACQUIRE);
+}
+
+/*
+ *  Called by the processing thread after every window, it does not use
+ *   curves acquired before the previous window anymore.
+ */
+void liveQuiescent(struct live_knobs *lk) {
+	__atomic_store_n(&lk->epoch, lk->epoch + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ *  Stops the watching thread and releases the knobs, processing has to
+ *   be already finished.
+ */
+void liveStop(struct live_knobs *lk) {
+	__atomic_store_n(&lk->stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(lk->watcher, NULL);
+	free(lk->cur);
+	free(lk->path);
+	free(lk);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  live.h
+ *
+ *    Description:  Live knobs. Watching thread reads knobs from a file
+ *                  whenever it changes, compiles their response curve and
+ *                  publishes it by atomic swap of one pointer. Processing
+ *                  thread only loads the pointer at the start of every
+ *                  window and reports finished windows, old curves are
+ *                  freed by the watching thread after the processing
+ *                  thread cannot use them anymore (RCU-like grace period).
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef LIVE_H_
+#define LIVE_H_
+
+#include <pthread.h>
+#include <time.h>
+
+#include "equalizer.h"
+
+/*
+ *  Knobs watched in file "path", curve "cur" is written only by the
+ *   watching thread, "epoch" (number of finished windows) only by the
+ *   processing thread.
+ */
+struct live_knobs {
+	char *path;
+	struct octave *oct;
+	int len;                /* Length of spectrum, which curves are compiled for */
+	int srate;
+	double *cur;            /* Published response curve */
+	unsigned long epoch;
+	int updates;            /* Number of published curves after the first one */
+	int stopping;
+	struct timespec mtime;  /* Modification time of the file, when it was read */
+	long long size;
+	pthread_t watcher;
+};
+
+
+extern struct live_knobs *liveStart(char *path, struct octave *oct, int len, int srate, double *gains);
+extern double *liveAcquire(struct live_knobs *lk);
+extern void liveQuiescent(struct live_knobs *lk);
+extern void liveStop(struct live_knobs *lk);
+
+#endif
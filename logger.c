@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  logger.c
+ *
+ *    Description:  Asynchronous logger. Every thread stores its messages
+ *                  as binary records (format string and values of the
+ *                  arguments) into its own lock-free ring buffer, separate
+ *                  thread formats them and writes them to the standard
+ *                  output, so the processing threads never wait for stdio.
+ *
+ *                  Only format string is parsed by the producing thread,
+ *                  to find out types of the arguments. Strings are copied
+ *                  into the record, because they may be freed before the
+ *                  record is formatted.
+ *
+ *                  Ring of finished thread is retired and taken over by
+ *                  the next new thread, so that threads of parallelFor
+ *                  do not allocate new rings every time.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "logger.h"
+#include "my_std.h"
+
+/* Number of records in ring buffer of one thread, must be power of 2 */
+#define RING_LEN 4096
+/* Maximal number of arguments of one message */
+#define REC_ARGS 12
+/* Space for all string arguments of one message */
+#define REC_STR 128
+/* How long the writing thread sleeps when all rings are empty (in ns) */
+#define IDLE_SLEEP 1000000
+
+/*
+ *  Value of one argument of the message.
+ */
+union arg {
+	long long i;
+	double d;
+	const void *p;
+};
+
+/*
+ *  One message stored in the ring buffer.
+ */
+struct record {
+	const char *text_form;  /* Format string, it must be literal */
+	int nargs;              /* # of used arguments */
+	union arg args[REC_ARGS];
+	char strs[REC_STR];     /* String arguments, "args" store offsets in it */
+};
+
+/*
+ *  Ring buffer of one thread, "head" is moved only by the thread
+ *   which owns the ring, "tail" only by the writing thread.
+ */
+struct ring {
+	unsigned int head;
+	unsigned int tail;
+	struct record recs[RING_LEN];
+	int retired;            /* Owner has finished, guarded by rings_lock */
+	struct ring *next;      /* Next ring in the list of all rings */
+};
+
+/* Set to 1 when messages are written by the separate thread */
+int log_async = 0;
+
+/* List of rings of all threads, which have logged something */
+static struct ring *rings = NULL;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Incremented by logStop, rings of older generation were released */
+static unsigned int generation = 0;
+/* Ring of the current thread and generation it belongs to */
+static __thread struct ring *my_ring = NULL;
+static __thread unsigned int my_gen = 0;
+/* Key whose destructor retires the ring, when its thread finishes */
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+/* Number of threads just storing a message, logStop waits for them */
+static int pushing = 0;
+
+static pthread_t writer;
+static int stopping = 0;
+
+
+/*
+ *  Destructor of "ring_key", gives the ring of finishing thread to the
+ *   next new one. Remaining records are still written by the writing
+ *   thread, new owner continues after them.
+ */
+static void retireRing(void *arg) {
+	pthread_mutex_lock(&rings_lock);
+	if (my_gen == generation) {
+		((struct ring *) arg)->retired = 1;
+	}
+	pthread_mutex_unlock(&rings_lock);
+	my_ring = NULL;
+}
+
+static void createRingKey(void) {
+	if (pthread_key_create(&ring_key, retireRing) != 0) {
+		perror("pthread_key_create");
+		exit (ERROR_EXIT_CODE);
+	}
+}
+
+/*
+ *  Returns ring of the current thread, the first call of every thread
+ *   takes over retired ring or allocates new one and adds it into the
+ *   list of all rings.
+ */
+static struct ring *getRing(void) {
+	if (my_ring != NULL && my_gen == __atomic_load_n(&generation, __ATOMIC_ACQUIRE)) {
+		return my_ring;
+	}
+	pthread_once(&ring_once, createRingKey);
+
+	struct ring *r;
+	pthread_mutex_lock(&rings_lock);
+	for (r=rings; r != NULL && !r->retired; r=r->next);
+	if (r != NULL) {
+		r->retired = 0;
+	} else {
+		if ((r = (struct ring *) calloc(1, sizeof(struct ring))) == NULL) {
+			perror("calloc");
+			exit (ERROR_EXIT_CODE);
+		}
+		r->next = rings;
+		__atomic_store_n(&rings, r, __ATOMIC_RELEASE);
+	}
+	my_gen = generation;
+	pthread_mutex_unlock(&rings_lock);
+	my_ring = r;
+	pthread_setspecific(ring_key, r);
+
+	return my_ring;
+}
+
+/*
+ *  Skips flags, width, precision and length modifiers of one conversion
+ *   in format string "f" (pointing after '%'). Returns pointer to the
+ *   conversion character, "lng" is set to number of 'l' modifiers
+ *   (2 for 'z'), "stars" to number of '*' (which take int arguments).
+ */
+static const char *parseSpec(const char *f, int *lng, int *stars) {
+	*lng = 0;
+	*stars = 0;
+	while (*f != '\0' && strchr("-+ #0123456789.*hlzjt", *f) != NULL) {
+		if (*f == 'l') {
+			(*lng)++;
+		} else if (*f == 'z' || *f == 'j' || *f == 't') {
+			*lng = 2;
+		} else if (*f == '*') {
+			(*stars)++;
+		}
+		f++;
+	}
+
+	return f;
+}
+
+/*
+ *  Stores message into the ring buffer of the current thread. If the
+ *   buffer is full, waits until the writing thread makes some space.
+ *   Message is printed directly, when logStop has already begun.
+ */
+void logPush(const char *text_form, va_list vl) {
+	__atomic_add_fetch(&pushing, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&log_async, __ATOMIC_SEQ_CST)) {
+		__atomic_sub_fetch(&pushing, 1, __ATOMIC_SEQ_CST);
+		vprintf(text_form, vl);
+		return;
+	}
+	struct ring *r = getRing();
+	unsigned int head = r->head;
+	while (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= RING_LEN) {
+		sched_yield();
+	}
+	struct record *rec = &r->recs[head & (RING_LEN - 1)];
+	rec->text_form = text_form;
+	rec->nargs = 0;
+
+	int spos = 0;
+	const char *f;
+	for (f=text_form; *f != '\0'; f++) {
+		if (*f != '%') {
+			continue;
+		}
+		int lng, stars;
+		f = parseSpec(f + 1, &lng, &stars);
+		if (*f == '\0') {
+			break;
+		}
+		for (; stars > 0 && rec->nargs < REC_ARGS; stars--) {
+			rec->args[rec->nargs++].i = va_arg(vl, int);
+		}
+		if (*f == '%' || rec->nargs >= REC_ARGS) {
+			continue;
+		}
+
+		union arg *a = &rec->args[rec->nargs++];
+		if (strchr("diouxXc", *f) != NULL) {
+			a->i = (lng == 0) ? va_arg(vl, int) : (lng == 1) ? va_arg(vl, long) : va_arg(vl, long long);
+		} else if (strchr("feEgGaA", *f) != NULL) {
+			a->d = va_arg(vl, double);
+		} else if (*f == 's') {
+			const char *s = va_arg(vl, const char *);
+			if (s == NULL) {
+				s = "(null)";
+			}
+			int len = MIN((int) strlen(s), REC_STR - 1 - spos);
+			memcpy(rec->strs + spos, s, MAX(len, 0));
+			rec->strs[spos + MAX(len, 0)] = '\0';
+			a->i = spos;
+			spos = MIN(spos + MAX(len, 0) + 1, REC_STR - 1);
+		} else {
+			a->p = va_arg(vl, const void *);
+		}
+	}
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&pushing, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ *  Formats one record and writes it to the standard output. Every
+ *   conversion of the format string is printed separately with its
+ *   own argument.
+ */
+static void writeRecord(struct record *rec) {
+	char spec[64];
+	int ai = 0;
+	const char *f = rec->text_form;
+
+	/* Lines of other threads must not get into the middle of this one */
+	flockfile(stdout);
+	while (*f != '\0') {
+		if (*f != '%') {
+			putchar(*f++);
+			continue;
+		}
+		int lng, stars;
+		const char *end = parseSpec(f + 1, &lng, &stars);
+		if (*end == '\0') {
+			break;
+		}
+		if (*end == '%') {
+			putchar('%');
+			f = end + 1;
+			continue;
+		}
+
+		/* Copy the conversion, '*' are replaced by their values */
+		int sl = 0;
+		for (; f <= end && sl < (int) sizeof(spec) - 12; f++) {
+			if (*f == '*') {
+				sl += sprintf(spec + sl, "%d", (ai < rec->nargs) ? (int) rec->args[ai++].i : 0);
+			} else {
+				spec[sl++] = *f;
+			}
+		}
+		spec[sl] = '\0';
+		f = end + 1;
+		if (ai >= rec->nargs) {
+			break;
+		}
+
+		union arg *a = &rec->args[ai++];
+		if (strchr("diouxXc", *end) != NULL) {
+			if (lng == 0) {
+				printf(spec, (int) a->i);
+			} else if (lng == 1) {
+				printf(spec, (long) a->i);
+			} else {
+				printf(spec, a->i);
+			}
+		} else if (strchr("feEgGaA", *end) != NULL) {
+			printf(spec, a->d);
+		} else if (*end == 's') {
+			printf(spec, rec->strs + a->i);
+		} else {
+			printf(spec, a->p);
+		}
+	}
+	funlockfile(stdout);
+}
+
+/*
+ *  Writes all records from all rings, returns number of written ones.
+ */
+static int drainRings(void) {
+	int count = 0;
+	struct ring *r;
+	for (r=__atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r=r->next) {
+		unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		while (r->tail != head) {
+			writeRecord(&r->recs[r->tail & (RING_LEN - 1)]);
+			__atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+			count++;
+		}
+	}
+	if (count > 0) {
+		fflush(stdout);
+	}
+
+	return count;
+}
+
+/*
+ *  Body of the writing thread, it sleeps for a while when there
+ *   is nothing to write.
+ */
+static void *writerLoop(void *arg) {
+	struct timespec idle = {0, IDLE_SLEEP};
+	while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+		if (drainRings() == 0) {
+			nanosleep(&idle, NULL);
+		}
+	}
+	drainRings();
+
+	return NULL;
+}
+
+/*
+ *  Starts the writing thread, all messages printed by log_out are
+ *   then written asynchronously. Remaining messages are written at
+ *   exit of the program. Returns 0 on success, -1 otherwise.
+ */
+int logStart(void) {
+	if (log_async) {
+		return 0;
+	}
+	fflush(stdout);
+	if (pthread_create(&writer, NULL, writerLoop, NULL) != 0) {
+		perror("pthread_create");
+		return -1;
+	}
+	__atomic_store_n(&log_async, 1, __ATOMIC_SEQ_CST);
+	atexit(logStop);
+
+	return 0;
+}
+
+/*
+ *  Switches log_out back to the standard output, waits for threads
+ *   which are just storing a message, writes all remaining messages,
+ *   stops the writing thread and releases all ring buffers. Rings
+ *   still referenced by other threads belong to the old generation
+ *   and are never used again.
+ */
+void logStop(void) {
+	if (!log_async) {
+		return;
+	}
+	__atomic_store_n(&log_async, 0, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&pushing, __ATOMIC_SEQ_CST) > 0) {
+		sched_yield();
+	}
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(writer, NULL);
+	stopping = 0;
+
+	pthread_mutex_lock(&rings_lock);
+	while (rings != NULL) {
+		struct ring *r = rings;
+		rings = r->next;
+		free(r);
+	}
+	__atomic_store_n(&generation, generation + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&rings_lock);
+	my_ring = NULL;
+}
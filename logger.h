@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  logger.h
+ *
+ *    Description:  Asynchronous logger. Every thread stores its messages
+ *                  as binary records (format string and values of the
+ *                  arguments) into its own lock-free ring buffer, separate
+ *                  thread formats them and writes them to the standard
+ *                  output, so the processing threads never wait for stdio.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef LOGGER_H_
+#define LOGGER_H_
+
+#include <stdarg.h>
+
+
+extern int log_async;
+
+extern int logStart(void);
+extern void logPush(const char *text_form, va_list vl);
+extern void logStop(void);
+
+#endif
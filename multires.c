@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  multires.c
+ *
+ *    Description:  Multi-resolution engine. Spectrum is split into few
+ *                  regions aligned with bands of Octave, every region is
+ *                  modified by windows of its own length (long windows for
+ *                  bass, short ones for treble) in sample rate reduced to
+ *                  its highest frequency. Regions are separated by
+ *                  complementary crossovers, so they sum back to the input.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "multires.h"
+#include "knobs.h"
+#include "fir.h"
+#include "equalizer.h"
+#include "complex.h"
+#include "my_std.h"
+
+/* Minimal number of FFT bins, which have to cover every band */
+#define MR_MIN_BINS 4
+/* Lower limit for the window length (in the full sample rate) */
+#define MR_MIN_WLEN 256
+/* Limits for the length of crossover filters */
+#define MR_MIN_TAPS 31
+#define MR_MAX_TAPS 16383
+/* Decimated Nyquist frequency is at least this times above the region */
+#define MR_GUARD 1.5
+
+
+/*
+ *  Returns length of Hamming windowed sinc filter, which has transition
+ *   band "width" Hz wide in sample rate "srate".
+ */
+static int transitionTaps(double width, int srate) {
+	int taps = (int) ceil(3.3*srate/width) | 1;
+	return MIN(MAX(taps, MR_MIN_TAPS), MR_MAX_TAPS);
+}
+
+/*
+ *  Returns width of transition band of the filter with "taps" coefficients.
+ */
+static double transitionWidth(int taps, int srate) {
+	return 3.3*srate/taps;
+}
+
+/*
+ *  Splits spectrum into regions. Every band gets window length, which is
+ *   the lowest power of 2 giving at least MR_MIN_BINS bins in this band,
+ *   neighbouring bands with window lengths in the same power of 4 form
+ *   one region. Window of the region is the longest one of its bands, so
+ *   none of them is under-resolved. Returns array of regions and stores
+ *   their number in "count".
+ */
+struct region *planRegions(struct octave *oct, int srate, int *count) {
+	struct region *regs;
+	if ((regs = (struct region *) malloc(MAX(oct->len, 1) * sizeof(struct region))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+
+	*count = 0;
+	int key = -1;
+	struct band *b;
+	for (b=oct->head; b != NULL && b->lowerE < srate/2.0; b=b->next) {
+		int need = (int) ceil(MR_MIN_BINS*srate/(b->upperE - b->lowerE));
+		int wlen = MIN(MAX(get_pow(need, 2), MR_MIN_WLEN), MR_MAX_WLEN);
+		int bkey = (int) log2(wlen)/2;
+
+		if (bkey != key) {
+			/* Start new region with the lower edge of this band */
+			if (*count > 0) {
+				regs[*count - 1].upper = b->lowerE;
+				regs[*count - 1].taps = transitionTaps((b->upperE - b->lowerE)/2.0, srate);
+			}
+			regs[*count].lower = (*count == 0) ? 0.0 : b->lowerE;
+			regs[*count].wlen = wlen;
+			(*count)++;
+			key = bkey;
+		}
+	}
+	/* The last region goes up to the Nyquist frequency */
+	if (*count == 0) {
+		regs[0].lower = 0.0;
+		regs[0].wlen = MR_MIN_WLEN;
+		*count = 1;
+	}
+	regs[*count - 1].upper = srate/2.0;
+	regs[*count - 1].taps = 0;
+
+	/* Every region is processed in the lowest sample rate it fits in */
+	int longest = regs[0].wlen;
+	int r;
+	for (r=0; r < *count; r++) {
+		double top = regs[r].upper;
+		if (regs[r].taps > 0) {
+			top += transitionWidth(regs[r].taps, srate);
+		}
+		regs[r].decim = 1;
+		while (srate/(2.0*regs[r].decim*2) >= MR_GUARD*top) {
+			regs[r].decim *= 2;
+		}
+	}
+
+	/*
+	 * Neighbouring regions in the same sample rate would only repeat
+	 * the same work, merge them and keep the longer window.
+	 */
+	int merged = 0;
+	for (r=1; r < *count; r++) {
+		if (regs[r].decim == regs[merged].decim) {
+			regs[merged].upper = regs[r].upper;
+			regs[merged].taps = regs[r].taps;
+			regs[merged].wlen = MAX(regs[merged].wlen, regs[r].wlen);
+		} else {
+			regs[++merged] = regs[r];
+		}
+	}
+	*count = merged + 1;
+
+	double work = 0.0;
+	for (r=0; r < *count; r++) {
+		regs[r].wlen = MAX(regs[r].wlen/regs[r].decim, MR_MIN_WLEN);
+		work += log2(regs[r].wlen)/regs[r].decim;
+		log_out(55, "Region %d: %.2fHz - %.2fHz, crossover %d taps, decimation %d, window %d\n",
+			r+1, regs[r].lower, regs[r].upper, regs[r].taps, regs[r].decim, regs[r].wlen);
+	}
+	/* FFT work per input sample compared to the longest window used everywhere */
+	log_out(55, "FFT work is %.0f%% of the work with window of %d samples\n", 100.0*work/log2(longest), longest);
+
+	return regs;
+}
+
+/*
+ *  Keeps only every "decim"-th sample of given track, which has to be
+ *   already band limited.
+ */
+static C_ARRAY *downsample(C_ARRAY *in, int decim) {
+	C_ARRAY *out = allocCA((in->len + decim - 1)/decim);
+	out->len = out->max;
+
+	int i;
+	for (i=0; i < out->len; i++) {
+		out->c[i].re = in->c[i*decim].re;
+	}
+
+	return out;
+}
+
+/*
+ *  Inserts "decim"-1 zeros between every two samples of "low" and removes
+ *   the images by low-pass filter. Content of the track goes up to "top" Hz.
+ *   Returned track has "len" samples.
+ */
+static C_ARRAY *upsample(C_ARRAY *low, int decim, double top, int srate, int len) {
+	C_ARRAY *up = allocCA(len);
+	up->len = len;
+
+	int i;
+	for (i=0; i < low->len && i*decim < len; i++) {
+		up->c[i*decim].re = decim*low->c[i].re;
+	}
+
+	/* The first image starts at the decimated sample rate minus "top" */
+	double nyq = srate/(2.0*decim);
+	C_ARRAY *lp = lowpassFIR(nyq, srate, transitionTaps(2.0*(nyq - top), srate));
+	C_ARRAY *out = convolveOS(up, lp, firDelay(lp, 0));
+	freeCA(up); freeCA(lp);
+
+	return out;
+}
+
+/*
+ *  Splits input track into regions by complementary crossovers, modifies
+ *   every region with its own window length in its own sample rate and sums
+ *   the regions back together. Returns new array with the result, which has
+ *   the same length as the input.
+ */
+C_ARRAY *multiRes(C_ARRAY *in, struct b_modif *head, struct octave *oct, int srate) {
+	int count;
+	struct region *regs = planRegions(oct, srate, &count);
+
+	C_ARRAY *res = allocCA(in->len);
+	res->len = in->len;
+	/* Low-pass version of the input bellow the lower edge of current region */
+	C_ARRAY *below = allocCA(in->len);
+	below->len = in->len;
+
+	int r, i;
+	for (r=0; r<count; r++) {
+		/* Region is difference of two neighbouring low-pass versions */
+		C_ARRAY *upto;
+		if (regs[r].taps > 0) {
+			C_ARRAY *lp = lowpassFIR(regs[r].upper, srate, regs[r].taps);
+			upto = convolveOS(in, lp, firDelay(lp, 0));
+			freeCA(lp);
+		} else {
+			upto = allocCA(in->len);
+			copyCA(in, 0, upto, 0, in->len);
+		}
+		C_ARRAY *part = allocCA(in->len);
+		part->len = in->len;
+		for (i=0; i < in->len; i++) {
+			part->c[i].re = upto->c[i].re - below->c[i].re;
+		}
+		freeCA(below);
+		below = upto;
+
+		/* Modify the region in the reduced sample rate */
+		int decim = regs[r].decim;
+		double top = regs[r].upper;
+		if (regs[r].taps > 0) {
+			top += transitionWidth(regs[r].taps, srate)/2.0;
+		}
+		C_ARRAY *low = downsample(part, decim);
+		C_ARRAY *mod = allocCA(low->len);
+		equalizeWindows(low, mod, head, oct, srate/decim, regs[r].wlen, regs[r].lower, regs[r].upper);
+
+		if (decim > 1) {
+			C_ARRAY *up = upsample(mod, decim, top, srate, in->len);
+			freeCA(mod);
+			mod = up;
+		}
+		for (i=0; i < in->len; i++) {
+			res->c[i].re += mod->c[i].re;
+		}
+
+		freeCA(part); freeCA(low); freeCA(mod);
+	}
+
+	freeCA(below);
+	free(regs);
+
+	return res;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  multires.h
+ *
+ *    Description:  Multi-resolution engine. Spectrum is split into few
+ *                  regions aligned with bands of Octave, every region is
+ *                  modified by windows of its own length (long windows for
+ *                  bass, short ones for treble) in sample rate reduced to
+ *                  its highest frequency. Regions are separated by
+ *                  complementary crossovers, so they sum back to the input.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef MULTIRES_H_
+#define MULTIRES_H_
+
+#include "complex.h"
+#include "equalizer.h"
+#include "knobs.h"
+
+/* Upper limit for the window length (in the full sample rate) */
+#define MR_MAX_WLEN 65536
+
+/*
+ *  One region of the spectrum processed with the same window length.
+ */
+struct region {
+	double lower;  // Lower edge of the region (in Hz)
+	double upper;  // Upper edge of the region (in Hz)
+	int taps;      // Length of the crossover filter at the upper edge
+	int decim;     // Decimation factor used for this region
+	int wlen;      // Window length in the decimated sample rate
+};
+
+
+extern struct region *planRegions(struct octave *oct, int srate, int *count);
+extern C_ARRAY *multiRes(C_ARRAY *in, struct b_modif *head, struct octave *oct, int srate);
+
+#endif
@@ -38,6 +38,7 @@
 
 #include "my_std.h"
 #include "string.h"
+#include "logger.h"
 
 
 /*
@@ -48,17 +49,20 @@ int debug = 90;
 
 
 /*
- *  Prints out to the standard output given message
- *   in printf-like format if "level" is higher than "debug".
+ *  Prints out to the standard output given message in printf-like
+ *   format, level of the message is checked by macro log_out. When
+ *   asynchronous logging is on, message is only stored and printed
+ *   later by the logger thread.
  */
-void log_out(int level, const char* text_form, ...) {
-	// Print only logs above desired importance
-	if (level > debug) {
-		va_list vl;
-		va_start(vl, text_form);
+void log_print(const char* text_form, ...) {
+	va_list vl;
+	va_start(vl, text_form);
+	if (__atomic_load_n(&log_async, __ATOMIC_RELAXED)) {
+		logPush(text_form, vl);
+	} else {
 		vprintf(text_form, vl);
-		va_end(vl);
 	}
+	va_end(vl);
 }
 
 /*
@@ -39,9 +39,26 @@
 
 #define ERROR_EXIT_CODE 2
 
+/*
+ *  Messages with level bellow LOG_FLOOR are removed at compile time,
+ *   release builds set it higher to get rid of the debugging ones.
+ */
+#ifndef LOG_FLOOR
+#define LOG_FLOOR 0
+#endif
+
+/* Evaluates to 1 if message with given level would be printed */
+#define log_on(level) ((level) >= LOG_FLOOR && (level) > debug)
+
+/*
+ *  Prints message in printf-like format if "level" is higher than "debug",
+ *   arguments are not evaluated at all if the message is not printed.
+ */
+#define log_out(level, ...) do { if (log_on(level)) log_print(__VA_ARGS__); } while (0)
+
 extern int debug;
 
-extern void log_out(int level, const char* text_form, ...);
+extern void log_print(const char* text_form, ...);
 extern int is_pow_of_2(int val);
 extern int get_pow(int val, int base);
 
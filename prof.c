@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  prof.c
+ *
+ *    Description:  Timing of the processing stages. Probes read monotonic
+ *                  clock before and after every stage (reading, FFT,
+ *                  modifications, IFFT, plotting, writing, ...), measured
+ *                  latencies are collected into histograms and summary
+ *                  with percentiles is printed at the end of the run.
+ *                  Probes do nothing unless profiling is enabled and they
+ *                  are removed completely when compiled with NO_PROF.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "prof.h"
+#include "my_std.h"
+
+/* Every power of 2 is divided into this number of linear buckets */
+#define SUB_BUCKETS 8
+/* log2(SUB_BUCKETS) */
+#define SUB_BITS 3
+/* Number of buckets covers whole range of 64-bit nanoseconds */
+#define BUCKETS (64*SUB_BUCKETS)
+
+
+/*
+ *  Histogram of latencies of one stage, bucket width grows with the
+ *   value, so the relative error of percentiles is at most 1/SUB_BUCKETS.
+ */
+struct histogram {
+	unsigned long long count;        /* # of measurements */
+	unsigned long long sum;          /* Sum of all latencies (in ns) */
+	unsigned long long max;          /* The longest latency (in ns) */
+	unsigned long long hist[BUCKETS];
+};
+
+/* Names of the stages used in the report */
+static const char *stage_names[PROF_STAGES] = {
+	"read", "fft", "modifs", "ifft", "plot", "write", "filter"
+};
+
+/* Set to 1 to turn on all probes */
+int prof_enabled = 0;
+
+static struct histogram stages[PROF_STAGES];
+
+
+/*
+ *  Returns current time of monotonic clock in nanoseconds.
+ */
+unsigned long long profNow(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ *  Returns index of the bucket for latency "ns".
+ */
+static int bucketIndex(unsigned long long ns) {
+	if (ns < SUB_BUCKETS) {
+		return (int) ns;
+	}
+	int e = 63 - __builtin_clzll(ns);
+	int sub = (int) (ns >> (e - SUB_BITS)) & (SUB_BUCKETS - 1);
+
+	return (e - SUB_BITS + 1)*SUB_BUCKETS + sub;
+}
+
+/*
+ *  Returns the highest latency which falls into bucket "b".
+ */
+static unsigned long long bucketValue(int b) {
+	if (b < SUB_BUCKETS) {
+		return b;
+	}
+	int e = b/SUB_BUCKETS + SUB_BITS - 1;
+	unsigned long long sub = b % SUB_BUCKETS;
+
+	return ((SUB_BUCKETS + sub + 1) << (e - SUB_BITS)) - 1;
+}
+
+/*
+ *  Adds one measured latency "ns" to the histogram of "stage".
+ */
+void profAdd(enum prof_stage stage, unsigned long long ns) {
+	struct histogram *h = &stages[stage];
+	h->count++;
+	h->sum += ns;
+	h->max = MAX(h->max, ns);
+	h->hist[bucketIndex(ns)]++;
+}
+
+/*
+ *  Returns latency (in ns), which is not exceeded by "p" fraction
+ *   of all measurements of given histogram.
+ */
+static unsigned long long percentile(struct histogram *h, double p) {
+	unsigned long long need = (unsigned long long) (p*h->count + 0.5);
+	unsigned long long seen = 0;
+	int b;
+	for (b=0; b<BUCKETS; b++) {
+		seen += h->hist[b];
+		if (seen >= MAX(need, 1)) {
+			return MIN(bucketValue(b), h->max);
+		}
+	}
+
+	return h->max;
+}
+
+/*
+ *  Prints out table with summary of all measured stages.
+ */
+void profReport(FILE *fout) {
+	fprintf(fout, "%-8s %8s %12s %12s %12s %12s %12s\n", "stage", "count",
+		"total[ms]", "mean[us]", "p50[us]", "p99[us]", "max[us]");
+	int s;
+	for (s=0; s<PROF_STAGES; s++) {
+		struct histogram *h = &stages[s];
+		if (h->count == 0) {
+			continue;
+		}
+		fprintf(fout, "%-8s %8llu %12.3f %12.3f %12.3f %12.3f %12.3f\n", stage_names[s], h->count,
+			h->sum*1e-6, h->sum*1e-3/h->count, percentile(h, 0.5)*1e-3,
+			percentile(h, 0.99)*1e-3, h->max*1e-3);
+	}
+}
+
+/*
+ *  Writes summary of all measured stages in JSON format into file
+ *   "fpath". Returns 0 on success, -1 otherwise.
+ */
+int profWriteReport(char *fpath) {
+	FILE *fout;
+	if ((fout = fopen(fpath, "w")) == NULL) {
+		perror("fopen");
+		return -1;
+	}
+
+	fprintf(fout, "{\n  \"stages\": [");
+	int s, n=0;
+	for (s=0; s<PROF_STAGES; s++) {
+		struct histogram *h = &stages[s];
+		if (h->count == 0) {
+			continue;
+		}
+		fprintf(fout, "%s\n    {\"stage\": \"%s\", \"count\": %llu, \"total_ns\": %llu, \"mean_ns\": %.1f, "
+			"\"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}", (n++ > 0) ? "," : "",
+			stage_names[s], h->count, h->sum, (double) h->sum/h->count,
+			percentile(h, 0.5), percentile(h, 0.99), h->max);
+	}
+	fprintf(fout, "\n  ]\n}\n");
+
+	if (fclose(fout) == EOF) {
+		perror("fclose");
+		return -1;
+	}
+
+	return 0;
+}
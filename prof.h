@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  prof.h
+ *
+ *    Description:  Timing of the processing stages. Probes read monotonic
+ *                  clock before and after every stage (reading, FFT,
+ *                  modifications, IFFT, plotting, writing, ...), measured
+ *                  latencies are collected into histograms and summary
+ *                  with percentiles is printed at the end of the run.
+ *                  Probes do nothing unless profiling is enabled and they
+ *                  are removed completely when compiled with NO_PROF.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdio.h>
+
+
+/*
+ *  Stages of the processing, which are measured separately.
+ */
+enum prof_stage {
+	PROF_READ = 0,   /* Reading of one input channel */
+	PROF_FFT = 1,    /* Transform of one window to frequency domain */
+	PROF_MODIFS = 2, /* Application of all knobs on one window */
+	PROF_IFFT = 3,   /* Transform of one window back to time domain */
+	PROF_PLOT = 4,   /* Drawing of one graph by gnuplot */
+	PROF_WRITE = 5,  /* Writing of one output channel */
+	PROF_FILTER = 6, /* One channel filtered by other engine than fft */
+	PROF_STAGES = 7, /* Number of stages, not a stage itself */
+};
+
+extern int prof_enabled;
+
+extern unsigned long long profNow(void);
+extern void profAdd(enum prof_stage stage, unsigned long long ns);
+extern void profReport(FILE *fout);
+extern int profWriteReport(char *fpath);
+
+/*
+ *  PROF_START declares variable "t" with the start time of the stage,
+ *   PROF_STOP adds time elapsed since then to the histogram of "stage".
+ */
+#ifdef NO_PROF
+#define PROF_START(t)
+#define PROF_STOP(stage, t)
+#else
+#define PROF_START(t) unsigned long long t = (prof_enabled) ? profNow() : 0
+#define PROF_STOP(stage, t) do { if (prof_enabled) profAdd((stage), profNow() - (t)); } while (0)
+#endif
+
+#endif
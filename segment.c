@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  segment.c
+ *
+ *    Description:  Segmented processing by more worker processes. The
+ *                  coordinator splits the tracks into segments aligned to
+ *                  windows, every segment is sent with margins on both
+ *                  sides through a pipe to its own worker process, which
+ *                  modifies it independently, and the coordinator puts
+ *                  the results together without the margins.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "segment.h"
+#include "knobs.h"
+#include "complex.h"
+#include "logger.h"
+#include "my_std.h"
+
+
+/*
+ *  Writes "len" bytes from "buf" into "fd". Returns 0 on success, -1
+ *   otherwise.
+ */
+static int writeAll(int fd, const void *buf, size_t len) {
+	const char *p = (const char *) buf;
+	while (len > 0) {
+		ssize_t w = write(fd, p, len);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		}
+		if (w <= 0) {
+			return -1;
+		}
+		p += w;
+		len -= w;
+	}
+
+	return 0;
+}
+
+/*
+ *  Reads exactly "len" bytes from "fd" into "buf". Returns 0 on success,
+ *   -1 on error or end of file.
+ */
+static int readAll(int fd, void *buf, size_t len) {
+	char *p = (char *) buf;
+	while (len > 0) {
+		ssize_t r = read(fd, p, len);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return -1;
+		}
+		p += r;
+		len -= r;
+	}
+
+	return 0;
+}
+
+/*
+ *  Sends "frames" samples of every channel of "cas" from sample "first"
+ *   into "fd". Returns 0 on success, -1 otherwise.
+ */
+static int sendSamples(int fd, C_ARRS *cas, long first, long frames) {
+	double *buf;
+	if ((buf = (double *) malloc(MAX(frames, 1) * sizeof(double))) == NULL) {
+		perror("malloc");
+		return -1;
+	}
+	int ch;
+	long i;
+	for (ch=0; ch < cas->len; ch++) {
+		for (i=0; i<frames; i++) {
+			buf[i] = cas->carrs[ch]->c[first + i].re;
+		}
+		if (writeAll(fd, buf, frames * sizeof(double)) != 0) {
+			free(buf);
+			return -1;
+		}
+	}
+	free(buf);
+
+	return 0;
+}
+
+/*
+ *  Receives "frames" samples of every channel of "cas" from "fd" and
+ *   stores them from sample "first". Returns 0 on success, -1 otherwise.
+ */
+static int recvSamples(int fd, C_ARRS *cas, long first, long frames) {
+	double *buf;
+	if ((buf = (double *) malloc(MAX(frames, 1) * sizeof(double))) == NULL) {
+		perror("malloc");
+		return -1;
+	}
+	int ch;
+	long i;
+	for (ch=0; ch < cas->len; ch++) {
+		if (readAll(fd, buf, frames * sizeof(double)) != 0) {
+			free(buf);
+			return -1;
+		}
+		for (i=0; i<frames; i++) {
+			setCA(cas->carrs[ch], first + i, buf[i], 0.0);
+		}
+	}
+	free(buf);
+
+	return 0;
+}
+
+/*
+ *  Allocates "nch" channels for "frames" samples, "len" of them are used.
+ */
+static C_ARRS *allocSegment(int nch, long frames, long len) {
+	C_ARRS *cas = allocCAS(nch);
+	for (cas->len=0; cas->len < nch; cas->len++) {
+		C_ARRAY *ca = allocCA(MAX(frames, 1));
+		ca->len = len;
+		cas->carrs[cas->len] = ca;
+	}
+
+	return cas;
+}
+
+/*
+ *  Body of the worker process, reads segments from "rfd" until the end
+ *   of the pipe, modifies them by "func" and sends the kept part of the
+ *   result into "wfd". Returns exit status of the worker.
+ */
+static int worker(int rfd, int wfd, seg_func func, void *ctx) {
+	struct seg_msg msg;
+	while (readAll(rfd, &msg, sizeof(msg)) == 0) {
+		if (msg.magic != SEG_MAGIC || msg.channels <= 0 || msg.frames <= 0 || msg.skip + msg.keep > msg.frames) {
+			fprintf(stderr, "Worker %d got invalid segment\n", getpid());
+			return ERROR_EXIT_CODE;
+		}
+		/* Engines fill the outputs from the start */
+		C_ARRS *ins = allocSegment(msg.channels, msg.frames, msg.frames);
+		C_ARRS *outs = allocSegment(msg.channels, msg.frames, 0);
+		if (recvSamples(rfd, ins, 0, msg.frames) != 0) {
+			fprintf(stderr, "Worker %d got incomplete segment\n", getpid());
+			return ERROR_EXIT_CODE;
+		}
+		log_out(45, "Worker %d modifies %ld samples from %ld\n", getpid(), (long) msg.frames, (long) msg.first);
+
+		/* Counters are copies of the coordinator's ones, send only the increase */
+		int wt = windows_total, ws = windows_skipped;
+		func(ins, outs, ctx);
+		msg.windows_total = windows_total - wt;
+		msg.windows_skipped = windows_skipped - ws;
+		if (writeAll(wfd, &msg, sizeof(msg)) != 0 || sendSamples(wfd, outs, msg.skip, msg.keep) != 0) {
+			perror("write");
+			return ERROR_EXIT_CODE;
+		}
+		freeCAS(ins);
+		freeCAS(outs);
+	}
+
+	return 0;
+}
+
+/*
+ *  Splits all channels "ins" (of the same length) into segments of whole
+ *   windows of "wlen" samples, one for each of "workers" processes. Every
+ *   worker gets its segment with "margin" samples on both sides through
+ *   a pipe, modifies it by "func" and sends back the segment without
+ *   margins, which is stored into "outs". Engines which reach at most
+ *   "margin" samples give the same result as for the whole track, fft
+ *   engine needs no margin at all. Returns 0 on success, -1 if some
+ *   worker fails.
+ */
+int runSegments(C_ARRS *ins, C_ARRS *outs, int workers, int wlen, int margin, seg_func func, void *ctx) {
+	long len = ins->carrs[0]->len;
+	long windows = (len + wlen - 1)/wlen;
+	workers = MAX(MIN(workers, windows), 1);
+	long seg = (windows + workers - 1)/workers*wlen;
+	workers = MAX((len + seg - 1)/seg, 1);
+
+	pid_t *pids;
+	int *to, *from;
+	if ((pids = (pid_t *) malloc(workers * sizeof(pid_t))) == NULL ||
+	    (to = (int *) malloc(workers * sizeof(int))) == NULL ||
+	    (from = (int *) malloc(workers * sizeof(int))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	printf("Splitting %ld samples into %d segments of %ld samples with margin %d\n", len, workers, seg, margin);
+	/* Buffered output would be printed by every worker again */
+	fflush(stdout);
+	fflush(stderr);
+
+	/* Dead worker is found by failed write, not by the signal */
+	struct sigaction sa, old_sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, &old_sa);
+
+	int w, k;
+	for (w=0; w<workers; w++) {
+		int req[2], res[2];
+		if (pipe(req) != 0 || pipe(res) != 0) {
+			perror("pipe");
+			exit (ERROR_EXIT_CODE);
+		}
+		if ((pids[w] = fork()) < 0) {
+			perror("fork");
+			exit (ERROR_EXIT_CODE);
+		}
+		if (pids[w] == 0) {
+			/* Pipes of the other workers would never get to the end */
+			for (k=0; k<w; k++) {
+				close(to[k]); close(from[k]);
+			}
+			close(req[1]); close(res[0]);
+			/* Logger thread is not in the worker */
+			log_async = 0;
+			int ret = worker(req[0], res[1], func, ctx);
+			fflush(stdout);
+			_exit (ret);
+		}
+		close(req[0]); close(res[1]);
+		to[w] = req[1];
+		from[w] = res[0];
+	}
+
+	/* Worker reads its whole segment before it answers, so sending first cannot block forever */
+	int ret = 0;
+	for (w=0; w<workers; w++) {
+		long a = w*seg, b = MIN(a + seg, len);
+		long st = MAX(a - margin, 0), en = MIN(b + margin, len);
+		struct seg_msg msg = {SEG_MAGIC, ins->len, st, en - st, a - st, b - a, 0, 0};
+		if (writeAll(to[w], &msg, sizeof(msg)) != 0 || sendSamples(to[w], ins, st, en - st) != 0) {
+			fprintf(stderr, "Segment %d cannot be sent to worker %d\n", w+1, pids[w]);
+			ret = -1;
+		}
+		close(to[w]);
+	}
+
+	for (w=0; w<workers; w++) {
+		struct seg_msg msg;
+		if (readAll(from[w], &msg, sizeof(msg)) != 0 || msg.magic != SEG_MAGIC ||
+		    msg.first != MAX(w*seg - margin, 0) || msg.skip + msg.keep > msg.frames ||
+		    recvSamples(from[w], outs, msg.first + msg.skip, msg.keep) != 0) {
+			fprintf(stderr, "Result of segment %d was not received from worker %d\n", w+1, pids[w]);
+			ret = -1;
+		} else {
+			windows_total += msg.windows_total;
+			windows_skipped += msg.windows_skipped;
+		}
+		close(from[w]);
+	}
+
+	for (w=0; w<workers; w++) {
+		int status;
+		if (waitpid(pids[w], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "Worker %d failed\n", pids[w]);
+			ret = -1;
+		}
+	}
+	sigaction(SIGPIPE, &old_sa, NULL);
+
+	for (k=0; k < outs->len; k++) {
+		outs->carrs[k]->len = len;
+	}
+	free(pids); free(to); free(from);
+
+	return ret;
+}
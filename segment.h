@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  segment.h
+ *
+ *    Description:  Segmented processing by more worker processes. The
+ *                  coordinator splits the tracks into segments aligned to
+ *                  windows, every segment is sent with margins on both
+ *                  sides through a pipe to its own worker process, which
+ *                  modifies it independently, and the coordinator puts
+ *                  the results together without the margins.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef SEGMENT_H_
+#define SEGMENT_H_
+
+#include <stdint.h>
+
+#include "complex.h"
+
+/* Identifies message of the segment protocol */
+#define SEG_MAGIC 0x73656766
+
+/*
+ *  Header of every message in both directions, samples of all channels
+ *   follow it as doubles, channel after channel. Segment starts at sample
+ *   "first" of the track, it has "frames" samples in every channel and
+ *   its result is in "keep" samples from "skip". Worker sends back only
+ *   the kept samples and the numbers of windows it processed.
+ */
+struct seg_msg {
+	uint32_t magic;
+	int32_t channels;
+	int64_t first;
+	int64_t frames;
+	int64_t skip;
+	int64_t keep;
+	int32_t windows_total;
+	int32_t windows_skipped;
+};
+
+/*
+ *  Modifies all channels "ins" of one segment into "outs", which has
+ *   the channels already allocated for the same length.
+ */
+typedef void (*seg_func)(C_ARRS *ins, C_ARRS *outs, void *ctx);
+
+
+extern int runSegments(C_ARRS *ins, C_ARRS *outs, int workers, int wlen, int margin, seg_func func, void *ctx);
+
+#endif
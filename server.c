@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  server.c
+ *
+ *    Description:  Interactive tuning server. Input is read and spectra of
+ *                  all its windows are computed only once, then they stay
+ *                  in memory. Commands with new knobs and requests for
+ *                  rendering of whole track or its part come either from
+ *                  standard input, or from local UNIX socket, every render
+ *                  only applies the knobs and IFFT on the needed windows.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "knobs.h"
+#include "equalizer.h"
+#include "complex.h"
+#include "wave.h"
+#include "fft.h"
+#include "prof.h"
+#include "my_std.h"
+
+/* Number of clients waiting for connection to the socket */
+#define SERVER_BACKLOG 4
+
+/*
+ *  State of the server, which lives between the commands.
+ */
+struct server {
+	C_ARRS *ins;           /* Input channels */
+	C_ARRAY ***spec;       /* Spectra of all windows of every channel */
+	int windows;           /* Number of windows of every channel */
+	int wlen;
+	int srate;
+	int bps;               /* Bits per sample of the input WAV */
+	struct octave *oct;
+	struct b_modif *modifs; /* Knobs set by the last command */
+};
+
+/*
+ *  One request for rendering, windows are split among threads.
+ */
+struct render {
+	struct server *srv;
+	int w0;                /* The first rendered window */
+	int s0, s1;            /* Rendered samples, from s0 to s1 (excluded) */
+	C_ARRS *outs;          /* Output channels with s1-s0 samples */
+};
+
+
+/*
+ *  Computes spectra of windows from "from" to "to" of all channels, two
+ *   channels are transformed together.
+ */
+static void computeSpectra(void *ctx, int from, int to) {
+	struct server *srv = (struct server *) ctx;
+	int wlen = srv->wlen;
+	C_ARRAY *win = allocCA(wlen);
+
+	int w, ch, j;
+	for (w=from; w<to; w++) {
+		for (ch=0; ch < srv->ins->len; ch+=2) {
+			C_ARRAY *in1 = srv->ins->carrs[ch];
+			C_ARRAY *in2 = (ch + 1 < srv->ins->len) ? srv->ins->carrs[ch+1] : NULL;
+			int wst = w*wlen;
+			int cnt = MIN(wlen, in1->len - wst);
+			initCA(win, wlen, 0);
+			for (j=0; j<cnt; j++) {
+				setCA(win, j, in1->c[wst + j].re, (in2 != NULL) ? in2->c[wst + j].re : 0.0);
+			}
+			win->len = wlen;
+			if (in2 != NULL) {
+				fftPair(win, &srv->spec[ch][w], &srv->spec[ch+1][w]);
+			} else {
+				srv->spec[ch][w] = fft(win);
+			}
+		}
+	}
+
+	freeCA(win);
+}
+
+/*
+ *  Returns new array with copy of spectrum "re" modified by all knobs
+ *   of the server.
+ */
+static C_ARRAY *modifiedCopy(struct server *srv, C_ARRAY *re) {
+	C_ARRAY *cp = allocCA(re->len);
+	copyCA(re, 0, cp, 0, re->len);
+	processModifs(srv->modifs, cp, srv->oct, srv->srate);
+
+	return cp;
+}
+
+/*
+ *  Stores samples of window "w" from time domain track "ire" into
+ *   output channel "out" of the render, only rendered samples are kept.
+ *   Real parts are taken if "imag" is 0, imaginary parts otherwise.
+ */
+static void storeWindow(struct render *r, C_ARRAY *out, int w, C_ARRAY *ire, int imag) {
+	int wst = w*r->srv->wlen;
+	int i;
+	for (i = MAX(wst, r->s0); i < MIN(wst + r->srv->wlen, r->s1); i++) {
+		out->c[i - r->s0].re = (imag) ? ire->c[i - wst].im : ire->c[i - wst].re;
+	}
+}
+
+/*
+ *  Renders windows from "from" to "to" (relative to the first rendered
+ *   window), modified spectra of two channels are transformed back by
+ *   one IFFT.
+ */
+static void renderWindows(void *ctx, int from, int to) {
+	struct render *r = (struct render *) ctx;
+	struct server *srv = r->srv;
+
+	int w, ch;
+	for (w = r->w0 + from; w < r->w0 + to; w++) {
+		for (ch=0; ch < srv->ins->len; ch+=2) {
+			C_ARRAY *re1 = modifiedCopy(srv, srv->spec[ch][w]);
+			if (ch + 1 < srv->ins->len) {
+				C_ARRAY *re2 = modifiedCopy(srv, srv->spec[ch+1][w]);
+				C_ARRAY *ire = ifftPair(re1, re2);
+				storeWindow(r, r->outs->carrs[ch], w, ire, 0);
+				storeWindow(r, r->outs->carrs[ch+1], w, ire, 1);
+				freeCA(ire); freeCA(re2);
+			} else {
+				C_ARRAY *ire = ifft(re1);
+				storeWindow(r, r->outs->carrs[ch], w, ire, 0);
+				freeCA(ire);
+			}
+			freeCA(re1);
+		}
+	}
+}
+
+/*
+ *  Renders samples from "s0" to "s1" with the current knobs into WAV
+ *   file "path". Returns 0 on success, -1 otherwise.
+ */
+static int render(struct server *srv, char *path, int s0, int s1) {
+	struct render r;
+	r.srv = srv;
+	r.s0 = s0;
+	r.s1 = s1;
+	r.w0 = s0/srv->wlen;
+	r.outs = allocCAS(srv->ins->len);
+
+	for (r.outs->len=0; r.outs->len < srv->ins->len; r.outs->len++) {
+		C_ARRAY *out = allocCA(s1 - s0);
+		out->len = s1 - s0;
+		r.outs->carrs[r.outs->len] = out;
+	}
+	parallelFor((s1 + srv->wlen - 1)/srv->wlen - r.w0, renderWindows, &r);
+
+	/* Header of every output is made again, it has its own length */
+	ELEMENT *h = createHeader(srv->ins->len, srv->srate, srv->bps, s1 - s0);
+	if (h == NULL) {
+		freeCAS(r.outs);
+		return -1;
+	}
+	writeWav(h, r.outs, path);
+	freeHeader(h);
+	freeCAS(r.outs);
+
+	return 0;
+}
+
+/*
+ *  Executes one command from "line" and writes the answer into "fout".
+ *   Returns 1 if the server should stop, 0 otherwise.
+ */
+static int command(struct server *srv, char *line, FILE *fout) {
+	char *save = NULL;
+	char *cmd = strtok_r(line, " \t\r\n", &save);
+	int len = srv->ins->carrs[0]->len;
+
+	if (cmd == NULL) {
+		return 0;
+	}
+	if (strcmp(cmd, "quit") == 0) {
+		fprintf(fout, "ok bye\n");
+		return 1;
+	}
+	if (strcmp(cmd, "info") == 0) {
+		fprintf(fout, "ok channels %d samples %d srate %d windows %d wlen %d\n", srv->ins->len, len, srv->srate, srv->windows, srv->wlen);
+		return 0;
+	}
+	if (strcmp(cmd, "knobs") == 0) {
+		char *list = strtok_r(NULL, " \t\r\n", &save);
+		struct b_modif *head = NULL;
+		if (list != NULL && initModifs(&head, srv->oct, list) != 0) {
+			freeModifs(head);
+			fprintf(fout, "error invalid knobs\n");
+			return 0;
+		}
+		freeModifs(srv->modifs);
+		srv->modifs = head;
+		fprintf(fout, "ok knobs %s\n", (list != NULL) ? list : "none");
+		return 0;
+	}
+	if (strcmp(cmd, "render") == 0) {
+		char *path = strtok_r(NULL, " \t\r\n", &save);
+		char *start = strtok_r(NULL, " \t\r\n", &save);
+		char *dur = strtok_r(NULL, " \t\r\n", &save);
+		if (path == NULL) {
+			fprintf(fout, "error render needs output path\n");
+			return 0;
+		}
+		/* Time range is given in seconds */
+		int s0 = (start != NULL) ? (int) (atof(start)*srv->srate) : 0;
+		int s1 = (dur != NULL) ? s0 + (int) (atof(dur)*srv->srate) : len;
+		s0 = MAX(s0, 0);
+		s1 = MIN(s1, len);
+		if (s0 >= s1) {
+			fprintf(fout, "error empty range\n");
+			return 0;
+		}
+
+		/* Unwritable path is found before the work is done */
+		int fd;
+		if ((fd = open(path, O_WRONLY | O_CREAT, 0644)) < 0) {
+			fprintf(fout, "error cannot write %s\n", path);
+			return 0;
+		}
+		close(fd);
+
+		unsigned long long t0 = profNow();
+		if (render(srv, path, s0, s1) != 0) {
+			fprintf(fout, "error cannot write %s\n", path);
+			return 0;
+		}
+		fprintf(fout, "ok %s %d %.3fms\n", path, s1 - s0, (profNow() - t0)*1e-6);
+		return 0;
+	}
+
+	fprintf(fout, "error unknown command %s\n", cmd);
+	return 0;
+}
+
+/*
+ *  Reads commands from "fin" and answers them into "fout" until end of
+ *   input or command quit. Returns 1 if the server should stop.
+ */
+static int serve(struct server *srv, FILE *fin, FILE *fout) {
+	char *line = NULL;
+	size_t lsize = 0;
+	int stop = 0;
+	while (!stop && getline(&line, &lsize, fin) != -1) {
+		stop = command(srv, line, fout);
+		fflush(fout);
+	}
+	free(line);
+
+	return stop;
+}
+
+/*
+ *  Accepts clients on UNIX socket "sock_path" one after another and
+ *   serves their commands. Returns 0 after quit, -1 on error.
+ */
+static int serveSocket(struct server *srv, char *sock_path) {
+	struct sockaddr_un addr;
+	if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path \"%s\" is too long\n", sock_path);
+		return -1;
+	}
+
+	int sfd;
+	if ((sfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, sock_path);
+	/* Socket left by previous server would block bind */
+	unlink(sock_path);
+	if (bind(sfd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(sfd, SERVER_BACKLOG) != 0) {
+		perror("bind");
+		close(sfd);
+		return -1;
+	}
+	printf("Listening on \"%s\"\n", sock_path);
+	fflush(stdout);
+
+	int stop = 0;
+	while (!stop) {
+		int cfd;
+		if ((cfd = accept(sfd, NULL, NULL)) < 0) {
+			perror("accept");
+			continue;
+		}
+		FILE *fin = fdopen(cfd, "r");
+		FILE *fout = fdopen(dup(cfd), "w");
+		if (fin == NULL || fout == NULL) {
+			perror("fdopen");
+			close(cfd);
+			continue;
+		}
+		stop = serve(srv, fin, fout);
+		fclose(fin); fclose(fout);
+	}
+	close(sfd);
+	unlink(sock_path);
+
+	return 0;
+}
+
+/*
+ *  Runs the server on input channels "ins" of WAV file with "header",
+ *   which is released here. Spectra of windows of "wlen" samples are
+ *   computed by all threads, the initial knobs are in "knobs" (can be
+ *   NULL). Commands are read from UNIX socket "sock_path", or from the
+ *   standard input if it is NULL. Every command is one line:
+ *     knobs [list]                      replaces all knobs (as by -k)
+ *     render path [start [duration]]    writes WAV with the given range
+ *                                       (in seconds, default is whole)
+ *     info                              describes the input
+ *     quit                              stops the server
+ *   Answer is one line starting with "ok" or "error", rendering answers
+ *   with the output path, number of samples and its duration.
+ */
+int runServer(C_ARRS *ins, ELEMENT *header, struct octave *oct, int wlen, char *knobs, char *sock_path) {
+	struct server srv;
+	srv.ins = ins;
+	srv.wlen = wlen;
+	srv.srate = getSampleRate(header);
+	srv.bps = getBitsPerSample(header);
+	srv.oct = oct;
+	srv.modifs = NULL;
+	srv.windows = (ins->carrs[0]->len + wlen - 1)/wlen;
+	/* Output headers are made for every render */
+	freeHeader(header);
+
+	if (knobs != NULL && initModifs(&srv.modifs, oct, knobs) != 0) {
+		return -1;
+	}
+
+	int ch;
+	if ((srv.spec = (C_ARRAY ***) malloc(ins->len * sizeof(C_ARRAY **))) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	for (ch=0; ch < ins->len; ch++) {
+		if ((srv.spec[ch] = (C_ARRAY **) malloc(MAX(srv.windows, 1) * sizeof(C_ARRAY *))) == NULL) {
+			perror("malloc");
+			exit (ERROR_EXIT_CODE);
+		}
+	}
+	unsigned long long t0 = profNow();
+	parallelFor(srv.windows, computeSpectra, &srv);
+	printf("Spectra of %d windows of %d channels computed in %.3fs\n", srv.windows, ins->len, (profNow() - t0)*1e-9);
+	fflush(stdout);
+
+	int ret = (sock_path != NULL) ? serveSocket(&srv, sock_path) : (serve(&srv, stdin, stdout), 0);
+
+	int w;
+	for (ch=0; ch < ins->len; ch++) {
+		for (w=0; w < srv.windows; w++) {
+			freeCA(srv.spec[ch][w]);
+		}
+		free(srv.spec[ch]);
+	}
+	free(srv.spec);
+	freeModifs(srv.modifs);
+
+	return ret;
+}
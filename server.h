@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  server.h
+ *
+ *    Description:  Interactive tuning server. Input is read and spectra of
+ *                  all its windows are computed only once, then they stay
+ *                  in memory. Commands with new knobs and requests for
+ *                  rendering of whole track or its part come either from
+ *                  standard input, or from local UNIX socket, every render
+ *                  only applies the knobs and IFFT on the needed windows.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "complex.h"
+#include "equalizer.h"
+#include "wave.h"
+
+
+extern int runServer(C_ARRS *ins, ELEMENT *header, struct octave *oct, int wlen, char *knobs, char *sock_path);
+
+#endif
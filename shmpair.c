@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  shmpair.c
+ *
+ *    Description:  Local producer and consumer of shared memory ring. WAV
+ *                  file is written into the ring block by block by one
+ *                  thread, blocks modified by befft (option -M) are read
+ *                  by another one and written into output WAV file at
+ *                  the end, so the ring interface can be tested and its
+ *                  throughput measured on one machine.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <pthread.h>
+
+#include "my_std.h"
+#include "complex.h"
+#include "wave.h"
+#include "prof.h"
+#include "shmring.h"
+
+/* Default number of frames in one block */
+#define DEFAULT_FRAMES 8192
+/* Default number of blocks in the ring */
+#define DEFAULT_BLOCKS 8
+
+
+/* Stores the name of this program */
+char const *program_name;
+
+/*
+ *  Ring and input tracks for the producing thread.
+ */
+struct producer {
+	struct shm_ring *ring;
+	C_ARRS *ins;
+};
+
+/*
+ *  Print out to the standard output information about usage of this program.
+ */
+static void usage(void) {
+	fprintf(stderr, "Usage: %s [-n frames] [-b blocks] name in_file out_file\n"
+		"   -n frames:  number of samples of every channel in one block, befft uses it as window length\n"
+		"        (default value is %d)\n\n"
+		"   -b blocks:  number of blocks in the ring\n"
+		"        (default value is %d)\n\n"
+		"   Creates shared memory ring \"name\", writes WAV file \"in_file\" into it and writes blocks\n"
+		"   processed by \"befft -M name\" into WAV file \"out_file\".\n", program_name, DEFAULT_FRAMES, DEFAULT_BLOCKS);
+	exit (ERROR_EXIT_CODE);
+}
+
+/*
+ *  Body of the producing thread, blocks of the input are written into
+ *   the ring, when the consumer makes space for them. The last one
+ *   is padded by zeros.
+ */
+static void *produce(void *arg) {
+	struct producer *pr = (struct producer *) arg;
+	struct shm_header *hdr = pr->ring->hdr;
+	int frames = hdr->frames, ch = hdr->channels;
+	long len = pr->ins->carrs[0]->len;
+
+	uint32_t head = 0;
+	uint32_t done = __atomic_load_n(&hdr->done, __ATOMIC_ACQUIRE);
+	long pos;
+	for (pos=0; pos < len; pos += frames) {
+		/* Ring is full, wait for the consumer */
+		while (SHM_COUNT(head - SHM_COUNT(done)) >= hdr->blocks) {
+			done = shmWait(&hdr->done, done);
+		}
+		float *blk = shmBlock(pr->ring, head);
+		int f, c;
+		for (f=0; f<frames; f++) {
+			for (c=0; c<ch; c++) {
+				blk[f*ch + c] = (pos + f < len) ? pr->ins->carrs[c]->c[pos + f].re : 0.0f;
+			}
+		}
+		shmAdvance(&hdr->head);
+		head = SHM_COUNT(head + 1);
+	}
+	hdr->total = len;
+	shmFinish(&hdr->head);
+
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	program_name = basename(argv[0]);
+
+	int opt;
+	int frames = DEFAULT_FRAMES;
+	int blocks = DEFAULT_BLOCKS;
+	while ((opt = getopt(argc, argv, "n:b:h")) != -1) {
+		switch (opt) {
+			case 'n':
+				frames = atoi(optarg);
+				break;
+			case 'b':
+				blocks = atoi(optarg);
+				break;
+			default:
+				usage();
+				break;
+		}
+	}
+	if (argc - optind != 3 || frames < 16 || blocks < 1) {
+		usage();
+	}
+	char *name = argv[optind], *in_file = argv[optind + 1], *out_file = argv[optind + 2];
+
+	C_ARRS *ins = allocCAS(8);
+	ELEMENT *header;
+	if ((header = readWav(ins, in_file)) == NULL) {
+		exit (ERROR_EXIT_CODE);
+	}
+	long len = ins->carrs[0]->len;
+	int ch = ins->len;
+
+	struct shm_ring *ring;
+	if ((ring = shmCreate(name, ch, getSampleRate(header), frames, blocks)) == NULL) {
+		exit (ERROR_EXIT_CODE);
+	}
+	printf("Ring \"%s\" with %d blocks of %d frames is ready for befft\n", name, blocks, frames);
+	fflush(stdout);
+
+	C_ARRS *outs = allocCAS(ch);
+	for (outs->len=0; outs->len < ch; outs->len++) {
+		outs->carrs[outs->len] = allocCA(len);
+		outs->carrs[outs->len]->len = len;
+	}
+
+	unsigned long long t0 = profNow();
+	struct producer pr = {ring, ins};
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, produce, &pr) != 0) {
+		perror("pthread_create");
+		shmClose(ring);
+		exit (ERROR_EXIT_CODE);
+	}
+
+	/* Consume blocks processed by befft until it finishes */
+	struct shm_header *hdr = ring->hdr;
+	uint32_t done = 0;
+	uint32_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+	long pos = 0;
+	for (;;) {
+		while (SHM_COUNT(tail) == done && !(tail & SHM_EOF)) {
+			tail = shmWait(&hdr->tail, tail);
+		}
+		if (SHM_COUNT(tail) == done) {
+			break;
+		}
+		float *blk = shmBlock(ring, done);
+		int f, c;
+		for (f=0; f < frames && pos + f < len; f++) {
+			for (c=0; c<ch; c++) {
+				outs->carrs[c]->c[pos + f].re = blk[f*ch + c];
+			}
+		}
+		pos += frames;
+		shmAdvance(&hdr->done);
+		done = SHM_COUNT(done + 1);
+	}
+	pthread_join(thread, NULL);
+	double secs = (profNow() - t0)*1e-9;
+	printf("Moved %ld frames of %d channels through the ring in %.3fs (%.1f MB/s)\n", len, ch, secs,
+		len*ch*sizeof(float)/MAX(secs, 1e-9)/1e6);
+
+	writeWav(header, outs, out_file);
+
+	shmClose(ring);
+	freeHeader(header);
+	freeCAS(ins);
+	freeCAS(outs);
+
+	return (0);
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  shmring.c
+ *
+ *    Description:  Ring of audio blocks in POSIX shared memory. Producer
+ *                  writes blocks of interleaved samples, befft modifies
+ *                  them in place and consumer reads them, so the samples
+ *                  are never copied through the kernel. Every side moves
+ *                  only its own counter and waits for the others by futex
+ *                  on their counters.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shmring.h"
+#include "my_std.h"
+
+/* Blocks start on the first page after the header */
+#define SHM_DATA_OFFSET 4096
+
+
+/*
+ *  Returns name of shared memory object, it has to start with '/'.
+ */
+static char *shmName(char *name) {
+	char *sname;
+	if ((sname = (char *) malloc(strlen(name) + 2)) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	sprintf(sname, "%s%s", (name[0] == '/') ? "" : "/", name);
+
+	return sname;
+}
+
+/*
+ *  Maps "size" bytes of shared memory object "fd" into new ring.
+ */
+static struct shm_ring *mapRing(int fd, char *sname, size_t size, int owner) {
+	struct shm_ring *ring;
+	if ((ring = (struct shm_ring *) calloc(1, sizeof(struct shm_ring))) == NULL) {
+		perror("calloc");
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		free(ring);
+		return NULL;
+	}
+	ring->name = sname;
+	ring->hdr = (struct shm_header *) map;
+	ring->data = (float *) ((char *) map + SHM_DATA_OFFSET);
+	ring->size = size;
+	ring->owner = owner;
+
+	return ring;
+}
+
+/*
+ *  Creates ring "name" of "blocks" blocks, every one with "frames"
+ *   samples of each of "channels" channels in sample rate "srate".
+ *   The ring is removed, when its creator closes it. Returns NULL
+ *   on error.
+ */
+struct shm_ring *shmCreate(char *name, int channels, int srate, int frames, int blocks) {
+	char *sname = shmName(name);
+	size_t size = SHM_DATA_OFFSET + (size_t) channels*frames*blocks*sizeof(float);
+
+	int fd;
+	if ((fd = shm_open(sname, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+		perror("shm_open");
+		free(sname);
+		return NULL;
+	}
+	if (ftruncate(fd, size) != 0) {
+		perror("ftruncate");
+		close(fd);
+		shm_unlink(sname);
+		free(sname);
+		return NULL;
+	}
+	struct shm_ring *ring;
+	if ((ring = mapRing(fd, sname, size, 1)) == NULL) {
+		shm_unlink(sname);
+		free(sname);
+		return NULL;
+	}
+
+	struct shm_header *hdr = ring->hdr;
+	hdr->format = SHM_FORMAT_F32;
+	hdr->channels = channels;
+	hdr->srate = srate;
+	hdr->frames = frames;
+	hdr->blocks = blocks;
+	hdr->total = 0;
+	hdr->head = hdr->tail = hdr->done = 0;
+	/* Who sees the magic, sees also the rest of the header */
+	__atomic_store_n(&hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+	return ring;
+}
+
+/*
+ *  Attaches ring "name" created by another process. Returns NULL if it
+ *   does not exist or it is not valid.
+ */
+struct shm_ring *shmAttach(char *name) {
+	char *sname = shmName(name);
+
+	int fd;
+	struct stat st;
+	if ((fd = shm_open(sname, O_RDWR, 0)) < 0 || fstat(fd, &st) != 0) {
+		perror("shm_open");
+		if (fd >= 0) {
+			close(fd);
+		}
+		free(sname);
+		return NULL;
+	}
+	if (st.st_size < SHM_DATA_OFFSET) {
+		fprintf(stderr, "Shared memory \"%s\" is not a ring\n", sname);
+		close(fd);
+		free(sname);
+		return NULL;
+	}
+	struct shm_ring *ring;
+	if ((ring = mapRing(fd, sname, st.st_size, 0)) == NULL) {
+		free(sname);
+		return NULL;
+	}
+
+	struct shm_header *hdr = ring->hdr;
+	if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC || hdr->format != SHM_FORMAT_F32 ||
+	    hdr->channels == 0 || hdr->frames == 0 || hdr->blocks == 0 ||
+	    ring->size < SHM_DATA_OFFSET + (size_t) hdr->channels*hdr->frames*hdr->blocks*sizeof(float)) {
+		fprintf(stderr, "Shared memory \"%s\" is not a valid ring\n", sname);
+		shmClose(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+/*
+ *  Unmaps the ring, the creator also removes it.
+ */
+void shmClose(struct shm_ring *ring) {
+	munmap(ring->hdr, ring->size);
+	if (ring->owner) {
+		shm_unlink(ring->name);
+	}
+	free(ring->name);
+	free(ring);
+}
+
+/*
+ *  Returns block number "count" (value of counter) in the ring.
+ */
+float *shmBlock(struct shm_ring *ring, uint32_t count) {
+	struct shm_header *hdr = ring->hdr;
+	return ring->data + (size_t) (SHM_COUNT(count) % hdr->blocks) * hdr->channels * hdr->frames;
+}
+
+/*
+ *  Waits until "counter" differs from "seen" and returns its new value.
+ *   Futex compares the counter with "seen" atomically, so no change can
+ *   be missed between the check and the sleep.
+ */
+uint32_t shmWait(uint32_t *counter, uint32_t seen) {
+	uint32_t cur;
+	while ((cur = __atomic_load_n(counter, __ATOMIC_ACQUIRE)) == seen) {
+		syscall(SYS_futex, counter, FUTEX_WAIT, seen, NULL, NULL, 0);
+	}
+
+	return cur;
+}
+
+/*
+ *  Wakes all processes waiting for "counter".
+ */
+static void wakeAll(uint32_t *counter) {
+	syscall(SYS_futex, counter, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ *  Moves "counter" by one block, only one side moves it, so there is no
+ *   need for atomic addition. Blocks written before are visible to
+ *   whoever sees the new value.
+ */
+void shmAdvance(uint32_t *counter) {
+	uint32_t cur = __atomic_load_n(counter, __ATOMIC_RELAXED);
+	__atomic_store_n(counter, SHM_COUNT(cur + 1) | (cur & SHM_EOF), __ATOMIC_RELEASE);
+	wakeAll(counter);
+}
+
+/*
+ *  Marks "counter" as finished, it will not be moved anymore.
+ */
+void shmFinish(uint32_t *counter) {
+	__atomic_or_fetch(counter, SHM_EOF, __ATOMIC_RELEASE);
+	wakeAll(counter);
+}
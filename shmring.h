@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  shmring.h
+ *
+ *    Description:  Ring of audio blocks in POSIX shared memory. Producer
+ *                  writes blocks of interleaved samples, befft modifies
+ *                  them in place and consumer reads them, so the samples
+ *                  are never copied through the kernel. Every side moves
+ *                  only its own counter and waits for the others by futex
+ *                  on their counters.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef SHMRING_H_
+#define SHMRING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Identifies initialized ring, it is written as the last field */
+#define SHM_MAGIC 0x62656666
+/* Samples are 32-bit floats from range [-1; 1], channels are interleaved */
+#define SHM_FORMAT_F32 1
+/* Flag of counter, its side will not move it anymore */
+#define SHM_EOF 0x80000000u
+/* Number of blocks stored in counter */
+#define SHM_COUNT(c) ((c) & ~SHM_EOF)
+
+/*
+ *  Header at the start of shared memory, blocks follow it. Counters
+ *   (numbers of blocks modulo 2^31) are in their own cache lines, "head"
+ *   is moved by producer, "tail" by befft and "done" by consumer.
+ */
+struct shm_header {
+	uint32_t magic;
+	uint32_t format;
+	uint32_t channels;
+	uint32_t srate;
+	uint32_t frames;    /* Samples of every channel in one block */
+	uint32_t blocks;    /* Number of blocks in the ring */
+	uint64_t total;     /* Number of valid frames, set before EOF of "head" */
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t tail __attribute__((aligned(64)));
+	uint32_t done __attribute__((aligned(64)));
+};
+
+/*
+ *  Mapped ring.
+ */
+struct shm_ring {
+	char *name;
+	struct shm_header *hdr;
+	float *data;
+	size_t size;
+	int owner;          /* Ring was created by this process */
+};
+
+
+extern struct shm_ring *shmCreate(char *name, int channels, int srate, int frames, int blocks);
+extern struct shm_ring *shmAttach(char *name);
+extern void shmClose(struct shm_ring *ring);
+
+extern float *shmBlock(struct shm_ring *ring, uint32_t count);
+extern uint32_t shmWait(uint32_t *counter, uint32_t seen);
+extern void shmAdvance(uint32_t *counter);
+extern void shmFinish(uint32_t *counter);
+
+#endif
@@ -0,0 +1,397 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  speccache.c
+ *
+ *    Description:  On-disk cache of spectra of all windows. Forward FFT of
+ *                  every window depends only on the input samples and on
+ *                  the way they are split into windows, so it is stored
+ *                  in memory mapped file named by hash of the input, window
+ *                  length, window type and hop. Later runs with other knobs
+ *                  take the spectra from the file instead of transforming.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "speccache.h"
+#include "equalizer.h"
+#include "complex.h"
+#include "prof.h"
+#include "my_std.h"
+
+/* Identification of the file format, changed with every change of the layout */
+#define CACHE_MAGIC "BEFFTSC1"
+/* Only rectangular window is used by fft engine now */
+#define WINDOW_RECT 0
+/* Spectra start on offset aligned to this */
+#define CACHE_ALIGN 64
+
+/*
+ *  Head of the cache file, followed by lengths of all channels.
+ */
+struct cache_head {
+	char magic[8];
+	unsigned long long hash;  /* Hash of all input samples */
+	int wlen;
+	int hop;                  /* Distance of the windows, the same as wlen */
+	int wtype;                /* Window function applied before FFT */
+	int half;
+	int bins;
+	int channels;
+};
+
+
+/*
+ *  Returns FNV-1a hash of all samples of all channels.
+ */
+static unsigned long long hashInput(C_ARRS *ins) {
+	unsigned long long hash = 14695981039346656037ULL;
+	int i, j;
+	size_t b;
+	for (i=0; i < ins->len; i++) {
+		for (j=0; j < ins->carrs[i]->len; j++) {
+			const unsigned char *p = (const unsigned char *) &ins->carrs[i]->c[j].re;
+			for (b=0; b < sizeof(double); b++) {
+				hash = (hash ^ p[b]) * 1099511628211ULL;
+			}
+		}
+		/* Channel boundaries are part of the content too */
+		hash = (hash ^ (unsigned) ins->carrs[i]->len) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/*
+ *  Converts float into IEEE 754 half precision number, rounded to nearest.
+ */
+static unsigned short toHalf(float f) {
+	union { float f; unsigned int u; } v;
+	v.f = f;
+	unsigned int sign = (v.u >> 16) & 0x8000;
+	int exp = (int) ((v.u >> 23) & 0xff) - 127 + 15;
+	unsigned int man = v.u & 0x7fffff;
+
+	if (exp <= 0) {
+		/* Subnormal number, or zero if it is too small */
+		if (exp < -10) {
+			return sign;
+		}
+		man |= 0x800000;
+		int shift = 14 - exp;
+		unsigned int h = man >> shift;
+		if ((man >> (shift - 1)) & 1) {
+			h++;
+		}
+		return sign | h;
+	}
+	if (exp >= 31) {
+		return sign | 0x7c00;
+	}
+
+	/* Carry of rounding can move into exponent, that is still correct */
+	unsigned int h = sign | (exp << 10) | (man >> 13);
+	if (man & 0x1000) {
+		h++;
+	}
+
+	return h;
+}
+
+/*
+ *  Converts IEEE 754 half precision number into float.
+ */
+static float fromHalf(unsigned short h) {
+	int exp = (h >> 10) & 0x1f;
+	int man = h & 0x3ff;
+	float f;
+
+	if (exp == 0) {
+		f = ldexpf(man, -24);
+	} else if (exp == 31) {
+		f = HUGE_VALF;
+	} else {
+		f = ldexpf(man | 0x400, exp - 25);
+	}
+
+	return (h & 0x8000) ? -f : f;
+}
+
+/*
+ *  Returns number of bytes of spectrum of one window.
+ */
+static size_t windowSize(struct spec_cache *cache) {
+	return (size_t) cache->bins * 2 * (cache->half ? sizeof(unsigned short) : sizeof(float));
+}
+
+/*
+ *  Returns pointer to spectrum of "w_i"-th window of channel "ch".
+ */
+static unsigned char *windowData(struct spec_cache *cache, int ch, int w_i) {
+	return cache->map + cache->offsets[ch] + (size_t) w_i * windowSize(cache);
+}
+
+/*
+ *  Stores first "cache->bins" bins of spectrum "re" as "w_i"-th window
+ *   of channel "ch".
+ */
+static void storeSpectrum(struct spec_cache *cache, int ch, int w_i, C_ARRAY *re) {
+	unsigned char *data = windowData(cache, ch, w_i);
+	int i;
+	for (i=0; i < cache->bins; i++) {
+		if (cache->half) {
+			unsigned short *h = (unsigned short *) data;
+			h[2*i] = toHalf(re->c[i].re);
+			h[2*i + 1] = toHalf(re->c[i].im);
+		} else {
+			float *f = (float *) data;
+			f[2*i] = re->c[i].re;
+			f[2*i + 1] = re->c[i].im;
+		}
+	}
+}
+
+/*
+ *  Releases memory of the cache, file stays as it is.
+ */
+static void freeSpecCache(struct spec_cache *cache) {
+	if (cache->map != NULL && cache->map != MAP_FAILED) {
+		munmap(cache->map, cache->size);
+	}
+	if (cache->fd >= 0) {
+		close(cache->fd);
+	}
+	free(cache->offsets);
+	free(cache->path);
+	free(cache->tmp_path);
+	free(cache);
+}
+
+/*
+ *  Returns 1 if mapped file has the expected head, 0 otherwise.
+ */
+static int validHead(struct spec_cache *cache, struct cache_head *expect, C_ARRS *ins) {
+	struct cache_head *head = (struct cache_head *) cache->map;
+	if (memcmp(head, expect, sizeof(struct cache_head)) != 0) {
+		return 0;
+	}
+
+	int *lens = (int *) (cache->map + sizeof(struct cache_head));
+	int i;
+	for (i=0; i < ins->len; i++) {
+		if (lens[i] != ins->carrs[i]->len) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ *  Opens cache of spectra of input channels "ins" split into windows of
+ *   "wlen" samples in directory "dir". If the file exists, spectra are
+ *   taken from it (cache->hit is set), otherwise new file is prepared
+ *   and it has to be filled by fillSpecCache. Returns NULL on error,
+ *   then the spectra have to be computed as without cache.
+ */
+struct spec_cache *openSpecCache(const char *dir, C_ARRS *ins, int wlen, int half) {
+	struct spec_cache *cache;
+	if ((cache = (struct spec_cache *) calloc(1, sizeof(struct spec_cache))) == NULL ||
+	    (cache->offsets = (size_t *) malloc(MAX(ins->len, 1) * sizeof(size_t))) == NULL ||
+	    (cache->path = (char *) malloc(strlen(dir) + 64)) == NULL ||
+	    (cache->tmp_path = (char *) malloc(strlen(dir) + 96)) == NULL) {
+		perror("malloc");
+		exit (ERROR_EXIT_CODE);
+	}
+	cache->fd = -1;
+	cache->wlen = wlen;
+	cache->bins = (wlen + 1)/2;
+	cache->half = half;
+	cache->channels = ins->len;
+
+	struct cache_head head;
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, CACHE_MAGIC, sizeof(head.magic));
+	head.hash = hashInput(ins);
+	head.wlen = head.hop = wlen;
+	head.wtype = WINDOW_RECT;
+	head.half = half;
+	head.bins = cache->bins;
+	head.channels = ins->len;
+
+	/* Layout of the file: head, lengths of channels, spectra of all windows */
+	size_t off = sizeof(struct cache_head) + ins->len * sizeof(int);
+	off = (off + CACHE_ALIGN - 1)/CACHE_ALIGN*CACHE_ALIGN;
+	int i;
+	for (i=0; i < ins->len; i++) {
+		cache->offsets[i] = off;
+		off += (size_t) ((ins->carrs[i]->len + wlen - 1)/wlen) * windowSize(cache);
+	}
+	cache->size = off;
+
+	sprintf(cache->path, "%s/%016llx-%d-rect-%d%s.spec", dir, head.hash, wlen, wlen, half ? "-f16" : "");
+	sprintf(cache->tmp_path, "%s.%d.tmp", cache->path, (int) getpid());
+
+	/* Complete file with the same head and size is used as it is */
+	struct stat st;
+	if ((cache->fd = open(cache->path, O_RDONLY)) >= 0) {
+		if (fstat(cache->fd, &st) == 0 && (size_t) st.st_size == cache->size &&
+		    (cache->map = mmap(NULL, cache->size, PROT_READ, MAP_SHARED, cache->fd, 0)) != MAP_FAILED &&
+		    validHead(cache, &head, ins)) {
+			cache->hit = 1;
+			free(cache->tmp_path);
+			cache->tmp_path = NULL;
+			log_out(55, "Spectra of all windows found in cache \"%s\"\n", cache->path);
+			return cache;
+		}
+		log_out(55, "Cache \"%s\" does not match the input, replacing it\n", cache->path);
+		if (cache->map != NULL && cache->map != MAP_FAILED) {
+			munmap(cache->map, cache->size);
+		}
+		cache->map = NULL;
+		close(cache->fd);
+	}
+
+	/* New file is written under temporary name, so that nobody reads it half done */
+	if ((cache->fd = open(cache->tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+		perror("open");
+		freeSpecCache(cache);
+		return NULL;
+	}
+	if (ftruncate(cache->fd, cache->size) != 0) {
+		perror("ftruncate");
+		unlink(cache->tmp_path);
+		freeSpecCache(cache);
+		return NULL;
+	}
+	if ((cache->map = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0)) == MAP_FAILED) {
+		perror("mmap");
+		unlink(cache->tmp_path);
+		freeSpecCache(cache);
+		return NULL;
+	}
+	memcpy(cache->map, &head, sizeof(head));
+	int *lens = (int *) (cache->map + sizeof(struct cache_head));
+	for (i=0; i < ins->len; i++) {
+		lens[i] = ins->carrs[i]->len;
+	}
+	log_out(55, "Spectra of all windows will be stored in cache \"%s\"\n", cache->path);
+
+	return cache;
+}
+
+/*
+ *  Computes spectra of all windows of all channels and stores them into
+ *   new cache. Silent windows are stored too, other knobs can make them
+ *   audible. Two channels of the same length are transformed together.
+ */
+void fillSpecCache(struct spec_cache *cache, C_ARRS *ins) {
+	int wlen = cache->wlen;
+	C_ARRAY *win = allocCA(wlen);
+	C_ARRAY *re1, *re2;
+
+	int ch, w_i, j;
+	for (ch=0; ch < ins->len; ch++) {
+		C_ARRAY *in1 = ins->carrs[ch];
+		C_ARRAY *in2 = (ch + 1 < ins->len && ins->carrs[ch+1]->len == in1->len) ? ins->carrs[ch+1] : NULL;
+		int win_num = (in1->len + wlen - 1)/wlen;
+		for (w_i=0; w_i < win_num; w_i++) {
+			int wst = w_i*wlen;
+			int cnt = MIN(wlen, in1->len - wst);
+			initCA(win, wlen, 0);
+			for (j=0; j<cnt; j++) {
+				setCA(win, j, in1->c[wst + j].re, (in2 != NULL) ? in2->c[wst + j].re : 0.0);
+			}
+			win->len = wlen;
+
+			PROF_START(t_fft);
+			if (in2 != NULL) {
+				fftPair(win, &re1, &re2);
+			} else {
+				re1 = fft(win);
+				re2 = NULL;
+			}
+			PROF_STOP(PROF_FFT, t_fft);
+
+			storeSpectrum(cache, ch, w_i, re1);
+			freeCA(re1);
+			if (re2 != NULL) {
+				storeSpectrum(cache, ch + 1, w_i, re2);
+				freeCA(re2);
+			}
+		}
+		if (in2 != NULL) {
+			ch++;
+		}
+	}
+
+	freeCA(win);
+}
+
+/*
+ *  Returns new array with spectrum of "w_i"-th window of channel "ch"
+ *   scaled like by fft(), bins which are not stored are zero.
+ */
+C_ARRAY *cachedSpectrum(struct spec_cache *cache, int ch, int w_i) {
+	C_ARRAY *re = allocCA(cache->wlen);
+	re->len = cache->wlen;
+	unsigned char *data = windowData(cache, ch, w_i);
+	int i;
+	for (i=0; i < cache->bins; i++) {
+		if (cache->half) {
+			unsigned short *h = (unsigned short *) data;
+			setCA(re, i, fromHalf(h[2*i]), fromHalf(h[2*i + 1]));
+		} else {
+			float *f = (float *) data;
+			setCA(re, i, f[2*i], f[2*i + 1]);
+		}
+	}
+
+	return re;
+}
+
+/*
+ *  Closes the cache, new file gets its final name only now, when it
+ *   is complete.
+ */
+void closeSpecCache(struct spec_cache *cache) {
+	if (cache->tmp_path != NULL) {
+		if (msync(cache->map, cache->size, MS_SYNC) != 0) {
+			perror("msync");
+		}
+		if (rename(cache->tmp_path, cache->path) != 0) {
+			perror("rename");
+			unlink(cache->tmp_path);
+		}
+	}
+	freeSpecCache(cache);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2014, Vojtech Vasek
+ *
+
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.*
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * ==============================================================================
+ *
+ *       Filename:  speccache.h
+ *
+ *    Description:  On-disk cache of spectra of all windows. Forward FFT of
+ *                  every window depends only on the input samples and on
+ *                  the way they are split into windows, so it is stored
+ *                  in memory mapped file named by hash of the input, window
+ *                  length, window type and hop. Later runs with other knobs
+ *                  take the spectra from the file instead of transforming.
+ *
+ *         Author:  Vojtech Vasek
+ *
+ * ==============================================================================
+ */
+
+#ifndef SPECCACHE_H_
+#define SPECCACHE_H_
+
+#include <stddef.h>
+
+#include "complex.h"
+
+
+/*
+ *  Opened cache file with spectra of all windows of all channels.
+ */
+struct spec_cache {
+	int fd;
+	unsigned char *map;  /* The whole file mapped into memory */
+	size_t size;
+	int wlen;            /* Window length, windows do not overlap */
+	int bins;            /* Number of stored bins of every window */
+	int half;            /* Values are stored as float16 instead of float */
+	int channels;
+	size_t *offsets;     /* Offset of spectra of every channel in the file */
+	int hit;             /* 1 if spectra were found in the cache */
+	char *path;          /* Name of the file */
+	char *tmp_path;      /* Name of the file until it is complete, NULL after hit */
+};
+
+extern struct spec_cache *openSpecCache(const char *dir, C_ARRS *ins, int wlen, int half);
+extern void fillSpecCache(struct spec_cache *cache, C_ARRS *ins);
+extern C_ARRAY *cachedSpectrum(struct spec_cache *cache, int ch, int w_i);
+extern void closeSpecCache(struct spec_cache *cache);
+
+#endif
@@ -73,3 +73,12 @@ echo -e "\nTEST #8: Noise reduction"
 infile="./tests/rain.wav"
 bandWav "${infile}" "47-67f-14,68-121f-24" 12
 playSound "${infile}"
+
+echo -e "\nTEST #9: Knobs without any change keep all samples (16-bit decoding)"
+infile="./tests/singing-female.wav"
+bandWav "${infile}" "1f+0"
+if cmp -s "${infile}" "${infile}.out.wav"; then
+	echo "Output is the same as the input"
+else
+	echo "FAILED: output differs from the input"
+fi
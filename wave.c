@@ -42,6 +42,7 @@
 
 #include "my_std.h"
 #include "wave.h"
+#include "prof.h"
 #include "complex.h"
 
 /* Standard number of elements in WAV head */
@@ -57,8 +58,11 @@
 #define LESS_SET(a, b) if ((a) < (b)) { (b) = (a); }
 #define MORE_SET(a, b) if ((a) > (b)) { (b) = (a); }
 
-/* Standard WAV format header */
-ELEMENT header[HEADER_SIZE] = {
+/*
+ *  Standard WAV format header, every read or created header is its own
+ *   copy of this layout, so that more files can be opened at once.
+ */
+static const ELEMENT layout[HEADER_SIZE] = {
 	{BE, 0, 4, "ChunkID", 0},        /* 0; RIFF or RIFX, RIFX means that default is big endian */
 	{LE, 4, 4, "ChunkSize", 0},      /* 1; */
 	{BE, 8, 4, "Format", 0},         /* 2; should contain text "WAVE" = 57 41 56 45 */
@@ -99,6 +103,18 @@ static unsigned long toInt(char *data, int size, ENDIAN endian) {
 	return ret;
 }
 
+/*
+ *  Stores integer value "val" into array of "size" bytes in specified
+ *   endian form, it's doing invers operation to the function toInt.
+ */
+static void fromInt(char *data, unsigned long val, int size, ENDIAN endian) {
+	int i;
+	for (i=0; i<size; i++) {
+		int shift = (endian == BE) ? (size - 1 - i)*8 : i*8;
+		data[i] = (char) ((val >> shift) & 0xFF);
+	}
+}
+
 /*
  *  Returns 1 if default endian is marked as Big, 0 otherwise.
  */
@@ -127,7 +143,8 @@ static double toDouble(char *data, int size) {
 		ret = (double) ((unsigned char *) data)[0];
 		ret = ret/255 - 0.5;
 	} else if (size == 2) {
-		ret = (double) ((char)data[0] + (char)data[1]*255);
+		/* Little endian two's complement, the lower byte is unsigned */
+		ret = (double) (short) ((data[0] & 0xFF) | ((data[1] & 0xFF) << 8));
 		ret /= 65535;
 	} else {
 		fprintf(stderr, "Unsupported byte length\n");
@@ -150,6 +167,13 @@ unsigned long getSampleRate(ELEMENT *h) {
 	return elementToInt(h, 7);
 }
 
+/*
+ *  Returns number of bits of one sample.
+ */
+unsigned int getBitsPerSample(ELEMENT *h) {
+	return elementToInt(h, 10);
+}
+
 /*
  *  Returns number of bytes in the data block.
  */
@@ -157,6 +181,14 @@ unsigned long getSubchunk2Size(ELEMENT *h) {
 	return elementToInt(h, 12);
 }
 
+/*
+ *  Stores integer value "val" into element on given position of header.
+ */
+static void setElement(ELEMENT *h, int pos, unsigned long val) {
+	int endian = 0x01 & (getEndian(h) | h[pos].endian);
+	fromInt(h[pos].data, val, h[pos].size, endian);
+}
+
 /*
  *  Compares data in element.data with given integer value
  *   and returns 0 if values are equal, 1 otherwise.
@@ -169,24 +201,48 @@ static int elementComp(ELEMENT *h, int pos, unsigned int val) {
 }
 
 /*
- *  Retrieve data from WAV file and save them in local element
- *   structure "header".
+ *  Allocates new header with the standard layout and zeroed data.
+ *   Returns NULL if allocation fails.
  */
-static int initHeader(int fd) {
-	log_out(45, "WAV header data:\n");
+static ELEMENT *newHeader(void) {
+	ELEMENT *header;
+	if ((header = (ELEMENT *) calloc(HEADER_SIZE, sizeof(ELEMENT))) == NULL) {
+		perror("calloc");
+		return NULL;
+	}
 	int i;
 	for (i=0; i<HEADER_SIZE; i++) {
-		int size = header[i].size;
- 		if ((header[i].data = (char *) calloc((size+1), sizeof(char))) == NULL) {
+		header[i] = layout[i];
+		if ((header[i].data = (char *) calloc((header[i].size+1), sizeof(char))) == NULL) {
 			perror("calloc");
-			return -1;
+			freeHeader(header);
+			return NULL;
 		}
+	}
+
+	return header;
+}
+
+/*
+ *  Retrieve data from WAV file and save them in new element
+ *   structure. Returns NULL on error.
+ */
+static ELEMENT *initHeader(int fd) {
+	ELEMENT *header;
+	if ((header = newHeader()) == NULL) {
+		return NULL;
+	}
+	log_out(45, "WAV header data:\n");
+	int i;
+	for (i=0; i<HEADER_SIZE; i++) {
+		int size = header[i].size;
 
 		/* Move to specific offset where data should be stored */
 		lseek(fd, header[i].offset, SEEK_SET);
 		if (read(fd, header[i].data, size) != size) {
-			fprintf(stderr, "Header was set incorrectly.");
-			exit (2);
+			fprintf(stderr, "Header was set incorrectly.\n");
+			freeHeader(header);
+			return NULL;
 		}
 		
 		log_out(45, "%s = ", header[i].name);
@@ -202,34 +258,79 @@ static int initHeader(int fd) {
 	/* Simple check, if file has WAVE header */
 	if (elementComp(header, 2, WAVE) != 0) {
 		fprintf(stderr, "Not a WAV file header\n");
-		return -1;
+		freeHeader(header);
+		return NULL;
 	}
 	/* Compression is not supported */
 	if (elementToInt(header, 5) != 1) {
 		fprintf(stderr, "Compression unsupported\n");
-		return -1;
+		freeHeader(header);
+		return NULL;
 	}
 
-	return 0;
+	return header;
+}
+
+/*
+ *  Prepares header for new WAV file with "nch" channels in sample rate
+ *   "srate", "bps" bits per sample and "nsamples" samples in every channel.
+ *   Returns pointer to the prepared header, NULL if allocation fails.
+ */
+ELEMENT *createHeader(unsigned int nch, unsigned long srate, unsigned int bps, unsigned long nsamples) {
+	ELEMENT *header;
+	if ((header = newHeader()) == NULL) {
+		return NULL;
+	}
+
+	unsigned long dsize = nsamples*nch*(bps/8);
+	setElement(header, 0, RIFF);
+	setElement(header, 1, 36 + dsize);
+	setElement(header, 2, WAVE);
+	setElement(header, 3, FMT);
+	setElement(header, 4, 16);
+	setElement(header, 5, 1);
+	setElement(header, 6, nch);
+	setElement(header, 7, srate);
+	setElement(header, 8, srate*nch*(bps/8));
+	setElement(header, 9, nch*(bps/8));
+	setElement(header, 10, bps);
+	setElement(header, 11, DATA);
+	setElement(header, 12, dsize);
+
+	return header;
 }
 
 /*
- *  Release memory allocated by ELEMENT structure and set
- *   its pointers to NULL.
+ *  Release memory allocated by ELEMENT structure, including
+ *   the structure itself.
  */
 void freeHeader(ELEMENT *h) {
+	if (h == NULL) {
+		return;
+	}
 	int i;
 	for (i=0; i<HEADER_SIZE; i++) {
 		free(h[i].data);
-		h[i].data = NULL;
 	}
+	free(h);
+}
+
+/*
+ *  Sets size of the data block in the header "h" to "nsamples" samples
+ *   in every channel, size of the whole file is changed accordingly.
+ */
+void setDataSize(ELEMENT *h, unsigned long nsamples) {
+	unsigned long dsize = nsamples*getNumChannels(h)*(getBitsPerSample(h)/8);
+	setElement(h, 1, 36 + dsize);
+	setElement(h, 12, dsize);
 }
 
 /*
  *  Returns "ch_id"-th sound channel from WAV file with file
- *   descriptor "fd".
+ *   descriptor "fd" and already read "header", only "count" samples from sample "first" are
+ *   read (all of them if "count" is negative).
  */
-static C_ARRAY *getChannel(int fd, short ch_id) {
+static C_ARRAY *getChannel(ELEMENT *header, int fd, short ch_id, long first, long count) {
 	/* Array for input samples */
 	C_ARRAY *ca;
  	ca = allocCA(512);
@@ -239,12 +340,16 @@ static C_ARRAY *getChannel(int fd, short ch_id) {
 	int bps = elementToInt(header, 10);
 	/* # of bytes per sample */
 	int B_SIZE = bps/8;
-	/* Jump to offset where the data starts */
-	lseek(fd, 44 + B_SIZE*ch_id, SEEK_SET);
 	/* # of channels */
 	int nch = elementToInt(header, 6);
 	/* # of total samples */
 	int tns = elementToInt(header, 12);
+	/* Jump to offset where the first wanted sample of this channel is */
+	lseek(fd, 44 + B_SIZE*(first*nch + ch_id), SEEK_SET);
+	long last = tns/(B_SIZE*nch) - first;
+	if (count >= 0) {
+		last = MIN(last, count);
+	}
 
 	char *buf;
 	if ((buf = (char *) calloc(B_SIZE, sizeof(char))) == NULL) {
@@ -255,7 +360,7 @@ static C_ARRAY *getChannel(int fd, short ch_id) {
 	 * At the end of file, there could be additional information,
 	 * therefore we do not want to exceed # of samples for this channel
 	 */
-	while (read(fd, buf, B_SIZE) > 0 && r < tns/(B_SIZE*nch)) {
+	while (r < last && read(fd, buf, B_SIZE) > 0) {
 		/* Check if we need more memory for next values */
 		if (ca->max == ca->len) {
 			reallocCA(ca, get_pow(ca->len + 64, 2));
@@ -274,6 +379,28 @@ static C_ARRAY *getChannel(int fd, short ch_id) {
 	return ca;
 }
 
+/*
+ *  Reads only header of WAV file "fpath", so that its parameters are
+ *   known before the data are read. Returns NULL on error.
+ */
+ELEMENT *readWavHeader(char *fpath) {
+	ELEMENT *header;
+	int fd;
+
+	if ((fd = open(fpath, O_RDONLY)) < 0) {
+		perror("open");
+		return NULL;
+	}
+	if ((header = initHeader(fd)) == NULL) {
+		fprintf(stderr, "Unacceptable WAVE header\n");
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+
+	return header;
+}
+
 /*
  *  Takes pointers to file, where it tries to read first header
  *   then if successful, it allocates space in given C_ARRS for
@@ -281,6 +408,16 @@ static C_ARRAY *getChannel(int fd, short ch_id) {
  *   one sound track.
  */
 ELEMENT *readWav(C_ARRS *cas, char *fpath) {
+	return readWavRange(cas, fpath, 0, -1);
+}
+
+/*
+ *  The same as readWav, but only "count" samples of every channel
+ *   from sample "first" are read, the data block is not read before
+ *   them. Negative "count" means all samples till the end.
+ */
+ELEMENT *readWavRange(C_ARRS *cas, char *fpath, long first, long count) {
+	ELEMENT *header;
 	int fd;
 
 	if ((fd = open(fpath, O_RDONLY)) < 0) {
@@ -288,7 +425,7 @@ ELEMENT *readWav(C_ARRS *cas, char *fpath) {
 		return NULL;
 	}
 	/* Read header data from file and store them */
-	if (initHeader(fd) != 0) {
+	if ((header = initHeader(fd)) == NULL) {
 		fprintf(stderr, "Unacceptable WAVE header\n");
 		close(fd);
 		return NULL;
@@ -306,7 +443,9 @@ ELEMENT *readWav(C_ARRS *cas, char *fpath) {
 	int i;
 	for (i=0; i<nch; i++) {
 		log_out(36, "Channel %d:\n", i+1);
-		cas->carrs[cas->len++] = getChannel(fd, i);
+		PROF_START(t_read);
+		cas->carrs[cas->len++] = getChannel(header, fd, i, first, count);
+		PROF_STOP(PROF_READ, t_read);
 	}
 
 	close(fd);
@@ -421,8 +560,10 @@ void writeWav(ELEMENT *h, C_ARRS *cas, char *fpath) {
 	/* Write all given channels */
 	int i;
 	for (i=0; i<nch; i++) {
-		printf("Writing out %d. channel...\n", i+1);
+		log_out(95, "Writing out %d. channel...\n", i+1);
+		PROF_START(t_write);
 		writeChannel(h, cas->carrs[i], fd, i);
+		PROF_STOP(PROF_WRITE, t_write);
 	}
 
 	close(fd);
@@ -61,9 +61,14 @@ typedef struct {
 
 extern unsigned int getNumChannels(ELEMENT *h);
 extern unsigned long getSampleRate(ELEMENT *h);
+extern unsigned int getBitsPerSample(ELEMENT *h);
 extern unsigned long getSubchunk2Size(ELEMENT *h);
 
+extern ELEMENT *createHeader(unsigned int nch, unsigned long srate, unsigned int bps, unsigned long nsamples);
+extern ELEMENT *readWavHeader(char *path);
 extern ELEMENT *readWav(C_ARRS *cas, char *path);
+extern ELEMENT *readWavRange(C_ARRS *cas, char *path, long first, long count);
+extern void setDataSize(ELEMENT *h, unsigned long nsamples);
 extern void freeHeader(ELEMENT *header);
 extern void writeWav(ELEMENT *h, C_ARRS *cas, char *fpath);
 